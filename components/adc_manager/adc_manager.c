@@ -4,6 +4,9 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "power_mgmt.h"
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -74,16 +77,20 @@ void insertion_sort(int samples[], int arr_len){
 int read_vltg_from_channel(adc_channel_t adc_channel){
   int samples[NUM_SAMPLES];
   int reading = 0;
+  int64_t start = esp_timer_get_time();
+  power_mgmt_acquire(PM_ADC); // keep the apb clock fixed for the whole burst of samples
   for(int i = 0; i<NUM_SAMPLES; i++){
     int raw = 0;
     ESP_ERROR_CHECK(adc_oneshot_read(adc_handle, adc_channel, &raw)); // sample the adc
     ESP_ERROR_CHECK(adc_cali_raw_to_voltage(adc_cali_handle, raw, &samples[i])); //converts the raw value to a calibrated voltage
   }
+  power_mgmt_release(PM_ADC);
   //sort the samples and drop the outer four
   insertion_sort(samples, NUM_SAMPLES);
   for(int i = 2; i < NUM_SAMPLES - 2; i++){
     reading += samples[i];
   }
   reading /= (NUM_SAMPLES - 4);
+  metric_observe(METRIC_ADC_READ_US, (uint32_t)(esp_timer_get_time() - start));
   return reading;
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "away_mode.h"
+#include "board.h"
+#include "serial_cmd.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#define IDLE_US ((int64_t)CONFIG_AWAY_MODE_IDLE_MIN * 60 * 1000000)
+#define CHECK_MS (CONFIG_AWAY_MODE_CHECK_INTERVAL_S * 1000)
+#define BAND CONFIG_AWAY_MODE_LIGHT_BAND_PCT
+#define SETTLE_MS 1000 // time for parked outputs to finish moving, the vent servo needs the longest
+
+typedef enum {
+  REQUEST_NONE = 0,
+  REQUEST_ENTER = 1,
+  REQUEST_LEAVE = 2,
+} AwayRequest;
+
+//kept in rtc memory so a deep sleep wake knows it was away and what the room looked like
+typedef struct {
+  bool away;
+  int parked_light; // light reading when away mode started
+  uint32_t checks; // checks that found the room unchanged
+} AwayState;
+
+static RTC_DATA_ATTR AwayState state;
+
+//only the controller task touches these
+static int64_t last_activity_us = 0;
+static int64_t band_start_us = 0;
+static int band_min = -1;
+static int band_max = -1;
+static int last_light = 0;
+
+static int request = REQUEST_NONE; // set from the console, taken by the controller
+
+static const char *TAG = "Away";
+
+#if CONFIG_AWAY_MODE_DEEP_SLEEP
+//outputs that would float in deep sleep, held at their parked level instead
+static const uint8_t held_pins[] = {FAN_PIN, LAMP_PIN, VENT_PIN};
+
+static void deep_sleep_now(){
+  //buttons are active low, ext0 takes one pin and ext1 with only one pin in its mask behaves the same
+  rtc_gpio_pullup_en(BUT_1_PIN);
+  rtc_gpio_pulldown_dis(BUT_1_PIN);
+  rtc_gpio_pullup_en(BUT_2_PIN);
+  rtc_gpio_pulldown_dis(BUT_2_PIN);
+  ESP_ERROR_CHECK(esp_sleep_enable_ext0_wakeup(BUT_1_PIN, 0));
+  ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup(1ULL << BUT_2_PIN, ESP_EXT1_WAKEUP_ALL_LOW));
+  ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup((uint64_t)CHECK_MS * 1000));
+  //ext0 needs the rtc peripherals powered, this also keeps the pullups on
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+
+  for(int i = 0; i < sizeof(held_pins); i++){
+    gpio_hold_en(held_pins[i]);
+  }
+  gpio_deep_sleep_hold_en();
+  esp_deep_sleep_start();
+}
+#endif
+
+static AwayChange enter(){
+  state.parked_light = last_light;
+  state.checks = 0;
+  __atomic_store_n(&state.away, true, __ATOMIC_RELAXED);
+  ESP_LOGI(TAG, "Entering away mode, light at %d%%", last_light);
+  return AWAY_ENTER;
+}
+
+static AwayChange leave(){
+  __atomic_store_n(&state.away, false, __ATOMIC_RELAXED);
+  //start both windows over so away mode is not entered again straight away
+  last_activity_us = esp_timer_get_time();
+  band_min = -1;
+  ESP_LOGI(TAG, "Leaving away mode after %" PRIu32 " checks", state.checks);
+  return AWAY_LEAVE;
+}
+
+static AwayChange take_request(){
+  switch(__atomic_exchange_n(&request, REQUEST_NONE, __ATOMIC_RELAXED)){
+    case(REQUEST_ENTER):
+      return state.away ? AWAY_NO_CHANGE : enter();
+    case(REQUEST_LEAVE):
+      return state.away ? leave() : AWAY_NO_CHANGE;
+    default:
+      return AWAY_NO_CHANGE;
+  }
+}
+
+AwayChange away_mode_activity(){
+  AwayChange change = take_request();
+  if(change != AWAY_NO_CHANGE){
+    return change;
+  }
+  last_activity_us = esp_timer_get_time();
+  return state.away ? leave() : AWAY_NO_CHANGE;
+}
+
+//absence is no interaction and a light level that has not moved for the idle period
+//while away the same reading is the periodic check, leaving the band means someone is back
+AwayChange away_mode_light(int pct){
+  last_light = pct;
+  AwayChange change = take_request();
+  if(change != AWAY_NO_CHANGE){
+    return change;
+  }
+
+  if(state.away){
+    if(abs(pct - state.parked_light) > BAND){
+      return leave();
+    }
+    state.checks++;
+    return AWAY_NO_CHANGE;
+  }
+
+  int64_t now = esp_timer_get_time();
+  if(band_min < 0 || pct > band_min + BAND || pct < band_max - BAND){
+    //reading left the band, start a new one around it
+    band_min = pct;
+    band_max = pct;
+    band_start_us = now;
+  }else{
+    band_min = pct < band_min ? pct : band_min;
+    band_max = pct > band_max ? pct : band_max;
+  }
+
+  if(now - last_activity_us >= IDLE_US && now - band_start_us >= IDLE_US){
+    return enter();
+  }
+  return AWAY_NO_CHANGE;
+}
+
+bool away_mode_is_away(){
+  return __atomic_load_n(&state.away, __ATOMIC_RELAXED);
+}
+
+int away_mode_sample_period_ms(int present_ms){
+  return away_mode_is_away() ? CHECK_MS : present_ms;
+}
+
+void away_mode_deep_sleep(){
+#if CONFIG_AWAY_MODE_DEEP_SLEEP
+  if(!esp_sleep_is_valid_wakeup_gpio(BUT_1_PIN) || !esp_sleep_is_valid_wakeup_gpio(BUT_2_PIN)){
+    ESP_LOGW(TAG, "Buttons are not RTC GPIOs, using light sleep");
+    return;
+  }
+  ESP_LOGI(TAG, "Deep sleep, checking every %d s", CONFIG_AWAY_MODE_CHECK_INTERVAL_S);
+  vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+  deep_sleep_now();
+#endif
+}
+
+AwayBoot away_mode_boot(int (*read_light)()){
+#if CONFIG_AWAY_MODE_DEEP_SLEEP
+  if(esp_reset_reason() == ESP_RST_DEEPSLEEP && state.away){
+    if(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER){
+      //nothing else has been started, so an unchanged room costs one adc read
+      if(abs(read_light() - state.parked_light) <= BAND){
+        state.checks++;
+        deep_sleep_now();
+      }
+    }
+    for(int i = 0; i < sizeof(held_pins); i++){
+      gpio_hold_dis(held_pins[i]);
+    }
+    gpio_deep_sleep_hold_dis();
+    ESP_LOGI(TAG, "Woke from away mode after %" PRIu32 " checks", state.checks);
+    state.away = false;
+    return AWAY_BOOT_RESUME;
+  }
+#endif
+  return AWAY_BOOT_NORMAL;
+}
+
+static void away_cmd(const char *args){
+  if(strcmp(args, "on") == 0){
+    __atomic_store_n(&request, REQUEST_ENTER, __ATOMIC_RELAXED);
+    printf("Away mode starts with the next sensor reading\n");
+  }else if(strcmp(args, "off") == 0){
+    __atomic_store_n(&request, REQUEST_LEAVE, __ATOMIC_RELAXED);
+    printf("Away mode ends with the next check\n");
+  }else{
+    printf("Away: %s, parked light %d%%, %" PRIu32 " checks\n", away_mode_is_away() ? "yes" : "no",
+           state.parked_light, state.checks);
+  }
+}
+
+void away_mode_init(){
+  serial_cmd_register("away", "away mode status, 'away on' or 'away off' to set it", away_cmd);
+}
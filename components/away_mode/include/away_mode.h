@@ -0,0 +1,36 @@
+#ifndef AWAY_MODE_H
+#define AWAY_MODE_H
+
+#include <stdbool.h>
+
+//what the caller has to do after feeding away mode an input
+typedef enum {
+  AWAY_NO_CHANGE = 0,
+  AWAY_ENTER = 1, // park the actuators and blank the display
+  AWAY_LEAVE = 2, // restore the actuators and display
+} AwayChange;
+
+//returned by away_mode_boot
+typedef enum {
+  AWAY_BOOT_NORMAL = 0, // power on or reset, nothing to restore
+  AWAY_BOOT_RESUME = 1, // woke from away deep sleep, restore the actuators once they are up
+} AwayBoot;
+
+void away_mode_init(); // registers the "away" console command
+
+//inputs, all from the controller task so decisions are made in one place
+AwayChange away_mode_activity(); // a button or the potentiometer was used
+AwayChange away_mode_light(int pct); // a photoresistor reading
+
+bool away_mode_is_away();
+int away_mode_sample_period_ms(int present_ms); // sensor period, stretched to the check interval while away
+
+//enters deep sleep when it is enabled and the buttons can wake the chip from it, otherwise returns
+//call once the actuators are parked and the display is blank
+void away_mode_deep_sleep();
+
+//call first in app_main, on a timer wake from deep sleep read_light is used to decide whether
+//to go straight back to sleep, in which case this does not return
+AwayBoot away_mode_boot(int (*read_light)());
+
+#endif
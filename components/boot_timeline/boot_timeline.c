@@ -0,0 +1,87 @@
+#include "boot_timeline.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#define MAX_MARKS 16
+
+typedef struct {
+  const char *stage;
+  int64_t time_us;
+  int core;
+} BootMark;
+
+static BootMark marks[MAX_MARKS];
+static int num_marks = 0;
+static unsigned completed_parts = 0;
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "Boot";
+
+void boot_mark(const char *stage){
+  int64_t now = esp_timer_get_time();
+  taskENTER_CRITICAL(&boot_lock);
+  if(num_marks < MAX_MARKS){
+    marks[num_marks++] = (BootMark){
+      .stage = stage,
+      .time_us = now,
+      .core = xPortGetCoreID(),
+    };
+  }
+  taskEXIT_CRITICAL(&boot_lock);
+}
+
+void boot_timeline_complete(BootPart part){
+  bool done;
+  taskENTER_CRITICAL(&boot_lock);
+  completed_parts |= part;
+  done = (completed_parts == BOOT_ALL);
+  taskEXIT_CRITICAL(&boot_lock);
+
+  if(done){
+    boot_timeline_print();
+  }
+}
+
+//returns the time of a stage or -1 if it was never marked
+static int64_t find_stage(const BootMark list[], int count, const char *stage){
+  for(int i = 0; i < count; i++){
+    if(strcmp(list[i].stage, stage) == 0){
+      return list[i].time_us;
+    }
+  }
+  return -1;
+}
+
+void boot_timeline_print(){
+  //marks from the two startup paths interleave, so sort a copy by time before printing
+  BootMark sorted[MAX_MARKS];
+  taskENTER_CRITICAL(&boot_lock);
+  int count = num_marks;
+  memcpy(sorted, marks, sizeof(marks));
+  taskEXIT_CRITICAL(&boot_lock);
+
+  for(int i = 1; i < count; i++){
+    BootMark temp = sorted[i];
+    int j = i - 1;
+    while(j >= 0 && sorted[j].time_us > temp.time_us){
+      sorted[j+1] = sorted[j];
+      j--;
+    }
+    sorted[j+1] = temp;
+  }
+
+  ESP_LOGI(TAG, "Boot timeline:");
+  int64_t prev = 0;
+  for(int i = 0; i < count; i++){
+    ESP_LOGI(TAG, " %8" PRId64 " us (+%7" PRId64 ") core %d  %s",
+             sorted[i].time_us, sorted[i].time_us - prev, sorted[i].core, sorted[i].stage);
+    prev = sorted[i].time_us;
+  }
+  ESP_LOGI(TAG, "Time to first frame: %" PRId64 " us", find_stage(sorted, count, BOOT_FIRST_FRAME));
+  ESP_LOGI(TAG, "Time to first control: %" PRId64 " us", find_stage(sorted, count, BOOT_FIRST_CONTROL));
+}
@@ -0,0 +1,19 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+//stage names used for the summary at the end of the timeline
+#define BOOT_FIRST_FRAME "first frame"
+#define BOOT_FIRST_CONTROL "first control"
+
+//independent parts of startup, the timeline is printed once all of them complete
+typedef enum {
+  BOOT_LOCAL = 1 << 0, //display, actuators, sensors and buttons
+  BOOT_NETWORK = 1 << 1, //nvs, then wifi and sntp unless the build is offline
+  BOOT_ALL = BOOT_LOCAL | BOOT_NETWORK,
+} BootPart;
+
+void boot_mark(const char *stage); // timestamp a stage, safe from any task
+void boot_timeline_complete(BootPart part); // mark a part as done, prints the timeline after the last one
+void boot_timeline_print();
+
+#endif
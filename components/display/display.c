@@ -1,5 +1,7 @@
 #include "board.h"
 #include "display.h"
+#include "widgets.h"
+#include "glyph_cache.h"
 #include "driver/gpio.h"
 #include "driver/i2c_master.h"
 #include "esp_err.h"
@@ -9,16 +11,30 @@
 
 #include "u8g2.h"
 #include "u8g2_esp32_hal.h"
+#include "trace.h"
+#include "metrics.h"
+#include "power_mgmt.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
 
-#define Y_START 14
-#define Y_INC 15
 #define X_START 6
 
-#define TEXT_HEIGHT_HALF 4
+//the _f setup keeps a whole frame, _2 and _1 keep 16 or 8 pixel rows and draw each screen once per page
+#if CONFIG_DISPLAY_BUFFER_PAGE_1
+#define DISPLAY_SETUP u8g2_Setup_ssd1306_i2c_128x64_noname_1
+#elif CONFIG_DISPLAY_BUFFER_PAGE_2
+#define DISPLAY_SETUP u8g2_Setup_ssd1306_i2c_128x64_noname_2
+#else
+#define DISPLAY_SETUP u8g2_Setup_ssd1306_i2c_128x64_noname_f
+#endif
 
-#define TRI_HALF_HEIGHT 5
-#define TRI_WIDTH 6
-#define TRI_OFFSET 3
+#define FRAME_BYTES (128 * 64 / 8)
+#define TILE_BYTES 8 // an 8x8 tile is 8 column bytes, top pixel in bit 0
+#define MERGE_GAP_TILES 1 // resending an unchanged tile is cheaper than starting another transfer
+
+#define POWER_UNCHANGED -1
 
 
 // u8g2: https://github.com/olikraus/u8g2/wiki/u8g2setupc
@@ -29,132 +45,421 @@
 // Draw String: https://github.com/olikraus/u8g2/wiki/u8g2reference#drawstr
 // Draw Triangle: https://github.com/olikraus/u8g2/wiki/u8g2reference
 static u8g2_esp32_hal_t u8g2_esp32_hal;
-static u8g2_t u8g2; // contains all data for the display
+static u8g2_t u8g2; // contains all data for the display, the screens draw with this one
+
+//a screen draws itself from its arguments, possibly more than once per frame
+//full is false when the target still holds the last frame and only changes need drawing
+typedef void (*DrawFn)(u8g2_t *target, const void *args, bool full);
+
+#if CONFIG_DISPLAY_BUFFER_FULL
+/**************************************
+ * Full frame buffer
+ * The ui composes into a back buffer and the render stage sends only what changed.
+ */
+
+static u8g2_t panel; // only the render stage talks to the display through this one
+
+//two frame buffers, the ui composes into back while the render stage sends front
+static uint8_t second_frame[FRAME_BYTES]; // the other one is the buffer u8g2 sets up
+static uint8_t *front;
+static uint8_t *back;
+static bool pending = false; // back holds a finished frame that has not been sent
+static bool drawing = false; // the ui is composing into back
+static int power_request = POWER_UNCHANGED;
+static TaskHandle_t render_task = NULL; // frames are sent by whoever finishes them until it runs
+static portMUX_TYPE frame_lock = portMUX_INITIALIZER_UNLOCKED;
+
+//copy of what the panel shows, each new frame is diffed against it
+static uint8_t sent_frame[FRAME_BYTES];
+static bool sent_valid = false; // panel ram is unknown until the first full frame
+
+//the full frame buffer is one row of 8 pixel high tiles after another
+static bool tile_changed(const uint8_t *frame, int tile){
+  return memcmp(&frame[tile * TILE_BYTES], &sent_frame[tile * TILE_BYTES], TILE_BYTES) != 0;
+}
 
+//send the runs of tiles that differ from the panel, returns how many tiles went out
+static int send_changed_tiles(){
+  uint8_t *frame = u8g2_GetBufferPtr(&panel);
+  int cols = u8g2_GetBufferTileWidth(&panel);
+  int rows = u8g2_GetBufferTileHeight(&panel);
+  if(!sent_valid){
+    u8g2_SendBuffer(&panel);
+    memcpy(sent_frame, frame, FRAME_BYTES);
+    sent_valid = true;
+    return cols * rows;
+  }
 
-void display_init(){
+  int sent = 0;
+  for(int row = 0; row < rows; row++){
+    int x = 0;
+    while(x < cols){
+      if(!tile_changed(frame, row * cols + x)){
+        x++;
+        continue;
+      }
+      //extend the run over changed tiles and short unchanged gaps
+      int start = x;
+      int end = x + 1;
+      for(int next = end; next < cols && next <= end + MERGE_GAP_TILES; next++){
+        if(tile_changed(frame, row * cols + next)){
+          end = next + 1;
+        }
+      }
+      u8g2_UpdateDisplayArea(&panel, start, row, end - start, 1);
+      int offset = (row * cols + start) * TILE_BYTES;
+      memcpy(&sent_frame[offset], &frame[offset], (end - start) * TILE_BYTES);
+      sent += end - start;
+      x = end;
+    }
+  }
+  return sent;
+}
 
+//push what changed in the front buffer to the display over i2c
+static void flush(){
+  TRACE(TRACE_DISPLAY_FLUSH_BEGIN, 0);
+  int64_t start = esp_timer_get_time();
+  power_mgmt_acquire(PM_DISPLAY); // i2c timing comes from the apb clock
+  int tiles = send_changed_tiles();
+  power_mgmt_release(PM_DISPLAY);
+  metric_add(METRIC_DISPLAY_TILES_SENT, tiles);
+  metric_observe(METRIC_DISPLAY_FLUSH_US, (uint32_t)(esp_timer_get_time() - start));
+  TRACE(TRACE_DISPLAY_FLUSH_END, 0);
+}
 
-  //initialize HAL for 2 wire i2c use
-  u8g2_esp32_hal = (u8g2_esp32_hal_t)U8G2_ESP32_HAL_DEFAULT;
-  u8g2_esp32_hal.bus.i2c.sda = SDA;
-  u8g2_esp32_hal.bus.i2c.scl = SCL;
-  u8g2_esp32_hal_init(u8g2_esp32_hal);
-  
-  //initialize u8g2 
+static void set_power(bool on){
+  power_mgmt_acquire(PM_DISPLAY);
+  u8g2_SetPowerSave(&panel, on ? 0 : 1);
+  power_mgmt_release(PM_DISPLAY);
+}
 
-  //the last two arguments come from the HAL
-  u8g2_Setup_ssd1306_i2c_128x64_noname_f(&u8g2, U8G2_R0,
-    u8g2_esp32_i2c_byte_cb,
-    u8g2_esp32_gpio_and_delay_cb); // i2c callback function for mapping
+//swap a finished back buffer to the front, false when there is nothing new to send
+//call with frame_lock held
+static bool take_frame(){
+  if(!pending || drawing){
+    return false;
+  }
+  uint8_t *sent = front;
+  front = back;
+  back = sent;
+  panel.tile_buf_ptr = front;
+  pending = false;
+  return true;
+}
 
-  // note that the address here is shifted to the left to include a R/W flag
-  u8x8_SetI2CAddress(&u8g2.u8x8,0x78); 
+//claim the back buffer for a new frame, a finished one still waiting in it is dropped for this one
+//unless the frame is drawn in full it starts as a copy of the newest one
+static void begin_frame(bool full){
+  portENTER_CRITICAL(&frame_lock);
+  bool stale = pending;
+  pending = false;
+  drawing = true;
+  u8g2.tile_buf_ptr = back;
+  const uint8_t *newest = stale ? back : front; // the render stage only swaps while nothing is pending
+  portEXIT_CRITICAL(&frame_lock);
+  if(stale){
+    metric_inc(METRIC_DISPLAY_FRAMES_DROPPED);
+  }
+  if(full){
+    u8g2_ClearBuffer(&u8g2);
+  }else if(newest != back){
+    memcpy(back, newest, FRAME_BYTES);
+  }
+}
 
-  u8g2_InitDisplay(&u8g2); 
-  u8g2_SetPowerSave(&u8g2, 0); // wake up display as it is initialized in sleep mode
-  u8g2_ClearBuffer(&u8g2);
+//hand the finished back buffer to the render stage
+static void end_frame(){
+  portENTER_CRITICAL(&frame_lock);
+  pending = true;
+  drawing = false;
+  TaskHandle_t renderer = render_task;
+  bool send = renderer == NULL && take_frame();
+  portEXIT_CRITICAL(&frame_lock);
+  if(renderer != NULL){
+    xTaskNotifyGive(renderer);
+  }else if(send){
+    flush(); // the boot frame goes out before the render stage starts
+  }
+}
 
-  u8g2_SetFont(&u8g2, u8g2_font_tenthinguys_t_all);
+void display_render_task(void *parameters){
+  portENTER_CRITICAL(&frame_lock);
+  render_task = xTaskGetCurrentTaskHandle();
+  portEXIT_CRITICAL(&frame_lock);
+  while(1){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    portENTER_CRITICAL(&frame_lock);
+    int power = power_request;
+    power_request = POWER_UNCHANGED;
+    bool send = take_frame();
+    portEXIT_CRITICAL(&frame_lock);
+
+    //wake the panel before the frame and blank it after, so neither is lost
+    if(power == 1){
+      set_power(true);
+    }
+    if(send){
+      flush();
+    }
+    if(power == 0){
+      set_power(false);
+    }
+  }
+}
 
+static void render(DrawFn draw, const void *args, bool full){
+  int64_t start = esp_timer_get_time();
+  begin_frame(full);
+  draw(&u8g2, args, full);
+  end_frame();
+  metric_observe(METRIC_DISPLAY_DRAW_US, (uint32_t)(esp_timer_get_time() - start));
 }
 
-void homeScreen(char inside_temp[], char outside_temp[], char cur_time[]){
-  //display placeholders for time here
-  u8g2_ClearBuffer(&u8g2);
-  u8g2_DrawRFrame(&u8g2, 0, 0, 128, 64, 5);
-  u8g2_DrawStr(&u8g2, X_START, Y_START,"Home");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+1*Y_INC,cur_time);
-  u8g2_DrawStr(&u8g2, X_START, Y_START+2*Y_INC,"Inside:");
-  u8g2_DrawStr(&u8g2, X_START+50, Y_START+2*Y_INC,inside_temp);
-  u8g2_DrawStr(&u8g2, X_START+80, Y_START+2*Y_INC,"C");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+3*Y_INC,"Outside:");
-  u8g2_DrawStr(&u8g2, X_START+60, Y_START+3*Y_INC,outside_temp);
-  u8g2_DrawStr(&u8g2, X_START+90, Y_START+3*Y_INC,"C");
+//both start out on the one buffer u8g2 keeps for this panel, second_frame is the other
+static u8g2_t *setup_panel(){
+  DISPLAY_SETUP(&u8g2, U8G2_R0, u8g2_esp32_i2c_byte_cb, u8g2_esp32_gpio_and_delay_cb);
+  DISPLAY_SETUP(&panel, U8G2_R0, u8g2_esp32_i2c_byte_cb, u8g2_esp32_gpio_and_delay_cb);
+  front = u8g2_GetBufferPtr(&panel);
+  back = second_frame;
+  return &panel;
+}
 
+//blank the panel without losing the frame, the controller keeps its ram while in power save
+//goes through the render stage so it lands in order with the frames around it
+void display_power(bool on){
+  portENTER_CRITICAL(&frame_lock);
+  TaskHandle_t renderer = render_task;
+  if(renderer != NULL){
+    power_request = on ? 1 : 0;
+  }
+  portEXIT_CRITICAL(&frame_lock);
+  if(renderer != NULL){
+    xTaskNotifyGive(renderer);
+  }else{
+    set_power(on);
+  }
+}
 
-  u8g2_SendBuffer(&u8g2);
+#else
+/**************************************
+ * Page buffer
+ * No frame is kept, every screen is drawn and sent a few rows at a time on the calling task.
+ */
 
+static void set_power(bool on){
+  power_mgmt_acquire(PM_DISPLAY);
+  u8g2_SetPowerSave(&u8g2, on ? 0 : 1);
+  power_mgmt_release(PM_DISPLAY);
 }
 
-void displayMenu(MenuItem menu[], int menu_len){
-  //max is 3
-  u8g2_ClearBuffer(&u8g2);
-  u8g2_DrawRFrame(&u8g2, 0, 0, 128, 64, 5);
+//u8g2 clips each pass to the rows its buffer holds and sends them when NextPage moves on
+//every page starts empty, so the screen is always drawn in full
+static void render(DrawFn draw, const void *args, bool full){
+  TRACE(TRACE_DISPLAY_FLUSH_BEGIN, 0);
+  int64_t start = esp_timer_get_time();
+  power_mgmt_acquire(PM_DISPLAY); // i2c timing comes from the apb clock
+  u8g2_FirstPage(&u8g2);
+  do{
+    draw(&u8g2, args, true);
+  }while(u8g2_NextPage(&u8g2));
+  power_mgmt_release(PM_DISPLAY);
+  uint32_t took_us = esp_timer_get_time() - start;
+  metric_observe(METRIC_DISPLAY_FLUSH_US, took_us);
+  metric_observe(METRIC_DISPLAY_DRAW_US, took_us); // drawing and sending are one loop here
+  TRACE(TRACE_DISPLAY_FLUSH_END, 0);
+}
 
-  for(int i = 0; i<menu_len; i++){
-    if(menu[i].selected == true){
-      u8g2_DrawTriangle(&u8g2, 
-                        X_START, 
-                        Y_START+i*Y_INC-TEXT_HEIGHT_HALF-TRI_HALF_HEIGHT, 
-                        X_START, 
-                        Y_START+i*Y_INC-TEXT_HEIGHT_HALF+TRI_HALF_HEIGHT, 
-                        X_START+TRI_WIDTH, 
-                        Y_START+i*Y_INC-TEXT_HEIGHT_HALF); //draw triangle to mark a selected item
-      u8g2_DrawStr(&u8g2, X_START+TRI_WIDTH+TRI_OFFSET, Y_START+i*Y_INC,menu[i].name);
-    }else{
-      u8g2_DrawStr(&u8g2, X_START, Y_START+i*Y_INC,menu[i].name);
-    }
+static u8g2_t *setup_panel(){
+  DISPLAY_SETUP(&u8g2, U8G2_R0, u8g2_esp32_i2c_byte_cb, u8g2_esp32_gpio_and_delay_cb);
+  return &u8g2;
+}
 
-  }
-  u8g2_SendBuffer(&u8g2);
+//blank the panel, the controller keeps its ram while in power save
+void display_power(bool on){
+  set_power(on);
+}
+#endif
 
+static void cache_labels(void);
 
-}
+void display_init(){
 
-void displayAdjust(MenuItem item){
-  //tells the user what sensor they are adjusting and tells them to press "select" to finish
-  u8g2_ClearBuffer(&u8g2);
-  u8g2_DrawRFrame(&u8g2, 0, 0, 128, 64, 5);
-  u8g2_DrawStr(&u8g2, X_START, Y_START+0*Y_INC,"Turn dial to");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+1*Y_INC,"adjust ");
-  u8g2_DrawStr(&u8g2, X_START+60, Y_START+1*Y_INC,item.name);
-  u8g2_DrawStr(&u8g2, X_START, Y_START+2*Y_INC,"Press button");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+3*Y_INC,"to stop.");
 
-  u8g2_SendBuffer(&u8g2);
+  //initialize HAL for 2 wire i2c use
+  u8g2_esp32_hal = (u8g2_esp32_hal_t)U8G2_ESP32_HAL_DEFAULT;
+  u8g2_esp32_hal.bus.i2c.sda = SDA;
+  u8g2_esp32_hal.bus.i2c.scl = SCL;
+  u8g2_esp32_hal_init(u8g2_esp32_hal);
+  
+  //initialize u8g2, the last two setup arguments come from the HAL
+  u8g2_t *bus = setup_panel();
 
+  // note that the address here is shifted to the left to include a R/W flag
+  u8x8_SetI2CAddress(&bus->u8x8,0x78); 
 
+  u8g2_InitDisplay(bus); 
+  u8g2_SetPowerSave(bus, 0); // wake up display as it is initialized in sleep mode
+
+  u8g2_SetFont(&u8g2, u8g2_font_tenthinguys_t_all);
+  glyph_cache_init(&u8g2);
+  cache_labels();
+}
+
+/**************************************
+ * Screens
+ * Each screen is a table of retained widgets. A frame is only drawn when a widget's data
+ * changed, and unless the screen was just switched to only those widgets are redrawn.
+ */
+
+typedef struct {
+  Widget *widgets;
+  int len;
+} Screen;
+
+typedef enum {
+  HOME_FRAME,
+  HOME_TITLE,
+  HOME_TIME,
+  HOME_INSIDE_LABEL,
+  HOME_INSIDE,
+  HOME_INSIDE_UNIT,
+  HOME_OUTSIDE_LABEL,
+  HOME_OUTSIDE,
+  HOME_OUTSIDE_UNIT,
+  HOME_TREND,
+  HOME_WIDGETS,
+} HomeWidget;
+
+static Sparkline home_trend;
+
+static Widget home_widgets[HOME_WIDGETS] = {
+  [HOME_FRAME]         = FRAME_WIDGET(),
+  [HOME_TITLE]         = LABEL_WIDGET(X_START,    0, 40, "Home"),
+  [HOME_TIME]          = VALUE_WIDGET(X_START,    1, 60),
+  [HOME_INSIDE_LABEL]  = LABEL_WIDGET(X_START,    2, 48, "Inside:"),
+  [HOME_INSIDE]        = VALUE_WIDGET(X_START+50, 2, 28),
+  [HOME_INSIDE_UNIT]   = LABEL_WIDGET(X_START+80, 2, 10, "C"),
+  [HOME_OUTSIDE_LABEL] = LABEL_WIDGET(X_START,    3, 58, "Outside:"),
+  [HOME_OUTSIDE]       = VALUE_WIDGET(X_START+60, 3, 28),
+  [HOME_OUTSIDE_UNIT]  = LABEL_WIDGET(X_START+90, 3, 10, "C"),
+  [HOME_TREND]         = SPARKLINE_WIDGET(68, 8, 24, &home_trend), // right of the title and time
+};
+
+typedef enum {
+  MENU_FRAME,
+  MENU_LIST,
+  MENU_WIDGETS,
+} MenuWidget;
+
+static Widget menu_widgets[MENU_WIDGETS] = {
+  [MENU_FRAME] = FRAME_WIDGET(),
+  [MENU_LIST]  = LIST_WIDGET(X_START, 0, 116, 4), // max is 4 items
+};
+
+//tells the user what sensor they are adjusting and tells them to press "select" to finish
+typedef enum {
+  ADJUST_FRAME,
+  ADJUST_LINE_1,
+  ADJUST_LINE_2,
+  ADJUST_NAME,
+  ADJUST_LINE_3,
+  ADJUST_LINE_4,
+  ADJUST_WIDGETS,
+} AdjustWidget;
+
+static Widget adjust_widgets[ADJUST_WIDGETS] = {
+  [ADJUST_FRAME]  = FRAME_WIDGET(),
+  [ADJUST_LINE_1] = LABEL_WIDGET(X_START,    0, 116, "Turn dial to"),
+  [ADJUST_LINE_2] = LABEL_WIDGET(X_START,    1, 56, "adjust "),
+  [ADJUST_NAME]   = VALUE_WIDGET(X_START+60, 1, 56),
+  [ADJUST_LINE_3] = LABEL_WIDGET(X_START,    2, 116, "Press button"),
+  [ADJUST_LINE_4] = LABEL_WIDGET(X_START,    3, 116, "to stop."),
+};
+
+//tells the user what they are changing, to use the down button to change it and "select" to finish
+//toggle and mode screens only differ in the choice offered
+typedef enum {
+  CHOICE_FRAME,
+  CHOICE_LINE_1,
+  CHOICE_LINE_2,
+  CHOICE_NAME,
+  CHOICE_NEXT,
+  CHOICE_LINE_3,
+  CHOICE_LINE_4,
+  CHOICE_WIDGETS,
+} ChoiceWidget;
+
+static Widget choice_widgets[CHOICE_WIDGETS] = {
+  [CHOICE_FRAME]  = FRAME_WIDGET(),
+  [CHOICE_LINE_1] = LABEL_WIDGET(X_START,    0, 116, "Press down to"),
+  [CHOICE_LINE_2] = LABEL_WIDGET(X_START,    1, 36, "turn "),
+  [CHOICE_NAME]   = VALUE_WIDGET(X_START+40, 1, 38),
+  [CHOICE_NEXT]   = VALUE_WIDGET(X_START+80, 1, 38),
+  [CHOICE_LINE_3] = LABEL_WIDGET(X_START,    2, 116, "Press select"),
+  [CHOICE_LINE_4] = LABEL_WIDGET(X_START,    3, 116, "to stop."),
+};
+
+static Screen home_screen = { home_widgets, HOME_WIDGETS };
+static Screen menu_screen = { menu_widgets, MENU_WIDGETS };
+static Screen adjust_screen = { adjust_widgets, ADJUST_WIDGETS };
+static Screen choice_screen = { choice_widgets, CHOICE_WIDGETS };
+
+//menu names are not known yet, they are cached the first time a menu shows them
+static void cache_labels(void){
+  const Screen *screens[] = { &home_screen, &menu_screen, &adjust_screen, &choice_screen };
+  for(int i = 0; i < sizeof(screens) / sizeof(screens[0]); i++){
+    widgets_cache_labels(&u8g2, screens[i]->widgets, screens[i]->len);
+  }
 }
 
+static const Screen *shown = NULL; // on the panel, or on its way there
 
-void displayToggle(MenuItem item, bool is_enabled){
-  //tells the user what sensor they are toggling and tells them to press "select" to finish
-  //tells the user to use down button to toggle
+static void draw_screen(u8g2_t *target, const void *args, bool full){
+  const Screen *screen = args;
+  widgets_draw(target, screen->widgets, screen->len, full);
+}
 
-  u8g2_ClearBuffer(&u8g2);
-  u8g2_DrawRFrame(&u8g2, 0, 0, 128, 64, 5);
-  u8g2_DrawStr(&u8g2, X_START, Y_START+0*Y_INC,"Press down to");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+1*Y_INC,"turn ");
-  u8g2_DrawStr(&u8g2, X_START+40, Y_START+1*Y_INC,item.name);
-  if(is_enabled){
-    u8g2_DrawStr(&u8g2, X_START+80, Y_START+1*Y_INC,"OFF");
-  }else{
-    u8g2_DrawStr(&u8g2, X_START+80, Y_START+1*Y_INC,"ON");
+//switching screens draws the new one in full, otherwise only its dirty widgets are drawn
+static void show(Screen *screen){
+  bool full = screen != shown;
+  if(!full && !widgets_dirty(screen->widgets, screen->len)){
+    return;
   }
-  u8g2_DrawStr(&u8g2, X_START, Y_START+2*Y_INC,"Press select");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+3*Y_INC,"to stop.");
+  render(draw_screen, screen, full);
+  widgets_clean(screen->widgets, screen->len);
+  shown = screen;
+}
 
-  u8g2_SendBuffer(&u8g2);
+void homeScreen(const char *inside_temp, const char *outside_temp, const char *cur_time){
+  widget_set_value(&home_widgets[HOME_TIME], cur_time);
+  widget_set_value(&home_widgets[HOME_INSIDE], inside_temp);
+  widget_set_value(&home_widgets[HOME_OUTSIDE], outside_temp);
+  show(&home_screen);
 }
 
-void displayMode(MenuItem item, bool is_auto){
-  //tells the user what sensor they are toggling and tells them to press "select" to finish
-  //tells the user to use down button to change mode
+void homeTrend(int16_t inside_tenths, int16_t outside_tenths){
+  widget_push_sample(&home_widgets[HOME_TREND], inside_tenths, outside_tenths);
+}
 
-  u8g2_ClearBuffer(&u8g2);
-  u8g2_DrawRFrame(&u8g2, 0, 0, 128, 64, 5);
-  u8g2_DrawStr(&u8g2, X_START, Y_START+0*Y_INC,"Press down to");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+1*Y_INC,"turn ");
-  u8g2_DrawStr(&u8g2, X_START+40, Y_START+1*Y_INC,item.name);
-  if(is_auto){
-    u8g2_DrawStr(&u8g2, X_START+80, Y_START+1*Y_INC,"MANU");
-  }else{
-    u8g2_DrawStr(&u8g2, X_START+80, Y_START+1*Y_INC,"AUTO");
-  }
-  u8g2_DrawStr(&u8g2, X_START, Y_START+2*Y_INC,"Press select");
-  u8g2_DrawStr(&u8g2, X_START, Y_START+3*Y_INC,"to stop.");
+void displayMenu(const Menu *menu, int selected){
+  widget_set_list(&menu_widgets[MENU_LIST], menu, selected);
+  show(&menu_screen);
+}
 
-  u8g2_SendBuffer(&u8g2);
+void displayAdjust(const MenuItem *item){
+  widget_set_value(&adjust_widgets[ADJUST_NAME], item->name);
+  show(&adjust_screen);
 }
 
+void displayToggle(const MenuItem *item, bool is_enabled){
+  widget_set_value(&choice_widgets[CHOICE_NAME], item->name);
+  widget_set_value(&choice_widgets[CHOICE_NEXT], is_enabled ? "OFF" : "ON");
+  show(&choice_screen);
+}
+
+void displayMode(const MenuItem *item, bool is_auto){
+  widget_set_value(&choice_widgets[CHOICE_NAME], item->name);
+  widget_set_value(&choice_widgets[CHOICE_NEXT], is_auto ? "MANU" : "AUTO");
+  show(&choice_screen);
+}
@@ -0,0 +1,161 @@
+#include "glyph_cache.h"
+#include "esp_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GLYPH_ROWS 16 // a cached bitmap is one 16 bit column per pixel column, top row in bit 0
+#define MAX_LABELS 32
+#define POOL_COLS CONFIG_DISPLAY_GLYPH_CACHE_COLS
+#define SCRATCH_PAGES (GLYPH_ROWS / 8)
+#define RASTER_LEFT 2 // room for glyphs that start left of the cursor
+
+typedef struct {
+  const char *text; // NULL for digits
+  uint16_t first; // first column in the pool
+  uint8_t width; // columns with ink
+  uint8_t advance; // how far u8g2 would move the cursor for this text
+} CachedText;
+
+static uint16_t pool[POOL_COLS];
+static int pool_used = 0;
+static CachedText digits[10];
+static CachedText labels[MAX_LABELS];
+static int num_labels = 0;
+static int raster_baseline; // bitmap row the text baseline sits on
+static bool ready = false; // the font fits in GLYPH_ROWS and the digits are cached
+
+//only ever drawn into while u8g2 is pointed at it, two pages of a full width frame buffer
+static uint8_t scratch[SCRATCH_PAGES * 128];
+
+static const char *TAG = "Glyph Cache";
+
+//draw the text once into the scratch pages and keep the columns that have ink
+//text is NULL for a single character
+static bool rasterize(u8g2_t *target, const char *text, char c, CachedText *cached){
+  uint8_t *frame = target->tile_buf_ptr;
+  uint8_t frame_pages = target->tile_buf_height;
+  //a label first met while its widget is drawn comes with that widget's clip window, the
+  //bitmap is kept whole and clipped when it is blitted instead
+  u8g2_uint_t clip_x0 = target->clip_x0;
+  u8g2_uint_t clip_y0 = target->clip_y0;
+  u8g2_uint_t clip_x1 = target->clip_x1;
+  u8g2_uint_t clip_y1 = target->clip_y1;
+  memset(scratch, 0, sizeof(scratch));
+  //u8g2 clips to the buffer window, so a glyph taller than expected cannot write past scratch
+  target->tile_buf_ptr = scratch;
+  target->tile_buf_height = SCRATCH_PAGES;
+  u8g2_SetBufferCurrTileRow(target, 0);
+  u8g2_SetMaxClipWindow(target);
+  int advance = text != NULL ? u8g2_DrawStr(target, RASTER_LEFT, raster_baseline, text) : u8g2_DrawGlyph(target, RASTER_LEFT, raster_baseline, c);
+  target->tile_buf_ptr = frame;
+  target->tile_buf_height = frame_pages;
+  u8g2_SetBufferCurrTileRow(target, 0);
+  u8g2_SetClipWindow(target, clip_x0, clip_y0, clip_x1, clip_y1);
+
+  int width = 0;
+  for(int col = 0; col < 128; col++){
+    if(scratch[col] != 0 || scratch[128 + col] != 0){
+      width = col + 1;
+    }
+  }
+  if(pool_used + width > POOL_COLS || advance > UINT8_MAX){
+    return false;
+  }
+  for(int col = 0; col < width; col++){
+    pool[pool_used + col] = scratch[col] | (scratch[128 + col] << 8);
+  }
+  *cached = (CachedText){ .text = text, .first = pool_used, .width = width, .advance = advance };
+  pool_used += width;
+  return true;
+}
+
+//rows of the frame u8g2 would draw into, its user window is the clip window within the buffer
+static uint64_t clip_rows(u8g2_t *target){
+  uint64_t below_y1 = target->user_y1 >= 64 ? UINT64_MAX : ((uint64_t)1 << target->user_y1) - 1;
+  uint64_t below_y0 = target->user_y0 >= 64 ? UINT64_MAX : ((uint64_t)1 << target->user_y0) - 1;
+  return below_y1 & ~below_y0;
+}
+
+//or the bitmap into the full frame buffer, each column lands across at most three pages
+//the pixels outside u8g2's clip window are left alone, as u8g2 itself would
+static void blit(u8g2_t *target, const CachedText *cached, int x, int baseline){
+  uint8_t *frame = u8g2_GetBufferPtr(target);
+  int stride = u8g2_GetBufferTileWidth(target) * 8;
+  int pages = u8g2_GetBufferTileHeight(target);
+  uint64_t rows = clip_rows(target);
+  int top = baseline - raster_baseline;
+  x -= RASTER_LEFT;
+  int page = (top + GLYPH_ROWS) / 8 - SCRATCH_PAGES; // rounds down for tops above the screen too
+  int shift = top - page * 8;
+  for(int col = 0; col < cached->width; col++){
+    if(x + col < target->user_x0 || x + col >= target->user_x1 || x + col >= stride){
+      continue;
+    }
+    uint32_t bits = (uint32_t)pool[cached->first + col] << shift;
+    for(int at = page; at < page + 3; at++, bits >>= 8){
+      if(at >= 0 && at < pages){
+        frame[at * stride + x + col] |= bits & (rows >> (at * 8)) & 0xff;
+      }
+    }
+  }
+}
+
+//cached bitmap of a label, rasterized on the first call for it
+static const CachedText *find_label(u8g2_t *target, const char *text){
+  for(int i = 0; i < num_labels; i++){
+    if(labels[i].text == text){
+      return &labels[i];
+    }
+  }
+  if(num_labels < MAX_LABELS && rasterize(target, text, 0, &labels[num_labels])){
+    return &labels[num_labels++];
+  }
+  return NULL;
+}
+
+bool glyph_cache_add(u8g2_t *target, const char *text){
+  return ready && find_label(target, text) != NULL;
+}
+
+void glyph_cache_draw_label(u8g2_t *target, int x, int baseline, const char *text){
+  const CachedText *cached = ready ? find_label(target, text) : NULL;
+  if(cached != NULL){
+    blit(target, cached, x, baseline);
+  }else{
+    u8g2_DrawStr(target, x, baseline, text); // out of room, drawn the slow way from now on
+  }
+}
+
+//same glyph by glyph walk as u8g2_DrawStr, with the digits taken from the cache
+void glyph_cache_draw_text(u8g2_t *target, int x, int baseline, const char *text){
+  if(!ready){
+    u8g2_DrawStr(target, x, baseline, text);
+    return;
+  }
+  for(const char *c = text; *c != '\0'; c++){
+    if(*c >= '0' && *c <= '9'){
+      blit(target, &digits[*c - '0'], x, baseline);
+      x += digits[*c - '0'].advance;
+    }else{
+      x += u8g2_DrawGlyph(target, x, baseline, (uint8_t)*c);
+    }
+  }
+}
+
+void glyph_cache_init(u8g2_t *target){
+  int ascent = u8g2_GetAscent(target);
+  int descent = u8g2_GetDescent(target); // zero or below the baseline
+  if(ascent - descent > GLYPH_ROWS){
+    ESP_LOGW(TAG, "Font is %d rows tall, more than the %d the cache holds", ascent - descent, GLYPH_ROWS);
+    return;
+  }
+  raster_baseline = GLYPH_ROWS - 1 + descent; // lowest descender on the last row, any spare rows go above
+  for(int d = 0; d < 10; d++){
+    if(!rasterize(target, NULL, '0' + d, &digits[d])){
+      ESP_LOGW(TAG, "No room for the digits, raise CONFIG_DISPLAY_GLYPH_CACHE_COLS");
+      return;
+    }
+  }
+  ready = true;
+}
@@ -1,24 +1,47 @@
 #ifndef USER_INTERFACE_H
 #define USER_INTERFACE_H
 #include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
 
+#define TREND_NONE INT16_MIN // no reading for this trend sample
 
+
+//menus are const tables, the screen keeps which item has the cursor
 typedef struct {
-  char *name;
-  bool selected;
+  const char *name;
+  int id; // what choosing the item means to the caller
 } MenuItem;
 
+typedef struct {
+  const MenuItem *items;
+  int len;
+} Menu;
+
 
 void display_init();
 
-void homeScreen();
+#if CONFIG_DISPLAY_BUFFER_FULL
+//sends the frames the screens below finish, the newest one wins when the bus falls behind
+//until it runs they go out on the task that drew them
+void display_render_task(void *parameters);
+#endif
+
+void display_power(bool on);
+
+//the screens below only send a frame when something they show changed
+
+void homeScreen(const char *inside_temp, const char *outside_temp, const char *cur_time);
+
+//add a column to the home screen temperature trend, in tenths of a degree, shown on the next homeScreen
+void homeTrend(int16_t inside_tenths, int16_t outside_tenths);
 
-void displayMenu(MenuItem menu[], int menu_len);
+void displayMenu(const Menu *menu, int selected);
 
-void displayAdjust(MenuItem item);
+void displayAdjust(const MenuItem *item);
 
-void displayToggle(MenuItem item, bool on);
+void displayToggle(const MenuItem *item, bool is_enabled);
 
-void displayMode(MenuItem item, bool is_auto);
+void displayMode(const MenuItem *item, bool is_auto);
 
 #endif
\ No newline at end of file
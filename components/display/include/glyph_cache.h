@@ -0,0 +1,34 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+#include <stdbool.h>
+#include "u8g2.h"
+#include "sdkconfig.h"
+
+#if CONFIG_DISPLAY_GLYPH_CACHE
+//call once the font is set, rasterizes the digits
+void glyph_cache_init(u8g2_t *target);
+
+//rasterize a label ahead of its first draw, false once the cache is full
+bool glyph_cache_add(u8g2_t *target, const char *text);
+
+//draw text whose pointer never changes and always points at the same characters, such as
+//labels and menu names. It is rasterized the first time and blitted from then on
+void glyph_cache_draw_label(u8g2_t *target, int x, int baseline, const char *text);
+
+//draw text that changes, digits are blitted and anything else goes through u8g2
+void glyph_cache_draw_text(u8g2_t *target, int x, int baseline, const char *text);
+#else
+//the cache only works on a full frame buffer, without it everything is drawn by u8g2
+static inline void glyph_cache_init(u8g2_t *target){}
+static inline bool glyph_cache_add(u8g2_t *target, const char *text){
+  return false;
+}
+static inline void glyph_cache_draw_label(u8g2_t *target, int x, int baseline, const char *text){
+  u8g2_DrawStr(target, x, baseline, text);
+}
+static inline void glyph_cache_draw_text(u8g2_t *target, int x, int baseline, const char *text){
+  u8g2_DrawStr(target, x, baseline, text);
+}
+#endif
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef WIDGETS_H
+#define WIDGETS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "u8g2.h"
+#include "display.h"
+
+#define WIDGET_VALUE_LEN 12 // longest value field plus its terminator
+#define WIDGET_ROW_HEIGHT 15 // text rows are this far apart
+#define WIDGET_ROW_ASCENT 11 // from the top of a row down to its text baseline
+#define WIDGET_ROW_TOP(row) (3 + (row) * WIDGET_ROW_HEIGHT) // four rows fit inside the screen frame
+
+typedef enum {
+  WIDGET_FRAME = 0,
+  WIDGET_LABEL = 1,
+  WIDGET_VALUE = 2,
+  WIDGET_LIST = 3,
+  WIDGET_SPARKLINE = 4,
+} WidgetKind;
+
+#define SPARKLINE_COLS 54 // one sample per column
+
+//fixed size history behind a sparkline, the inside series is filled in and the outside one dotted
+typedef struct {
+  int16_t inside[SPARKLINE_COLS]; // rings, the newest sample is at (count - 1) % SPARKLINE_COLS
+  int16_t outside[SPARKLINE_COLS];
+  int count; // samples pushed so far
+  int scrolled; // samples pushed since the widget was last drawn
+  bool rescaled; // the scale changed since then, every column has to be redrawn
+  int16_t lo; // scale in force, whole degrees that only move when the range of the samples does
+  int16_t hi;
+} Sparkline;
+
+//a retained piece of a screen, it only redraws when the data bound to it changes
+//and then only inside its own box
+typedef struct {
+  WidgetKind kind;
+  int16_t x; // bounding box
+  int16_t y;
+  int16_t w;
+  int16_t h;
+  const char *text; // labels
+  char value[WIDGET_VALUE_LEN]; // value fields keep a copy so a change can be spotted
+  const Menu *menu; // lists
+  int selected; // list item with the cursor
+  Sparkline *spark;
+  bool dirty;
+} Widget;
+
+//widgets for the screen tables, x and w in pixels and rows counted from the top
+#define FRAME_WIDGET() \
+  { .kind = WIDGET_FRAME, .x = 0, .y = 0, .w = 128, .h = 64 }
+#define LABEL_WIDGET(left, row, width, label) \
+  { .kind = WIDGET_LABEL, .x = (left), .y = WIDGET_ROW_TOP(row), .w = (width), .h = WIDGET_ROW_HEIGHT, .text = (label) }
+#define VALUE_WIDGET(left, row, width) \
+  { .kind = WIDGET_VALUE, .x = (left), .y = WIDGET_ROW_TOP(row), .w = (width), .h = WIDGET_ROW_HEIGHT }
+#define LIST_WIDGET(left, row, width, rows) \
+  { .kind = WIDGET_LIST, .x = (left), .y = WIDGET_ROW_TOP(row), .w = (width), .h = (rows) * WIDGET_ROW_HEIGHT }
+//top and height are in pixels and multiples of 8, so a scroll moves whole bytes of the frame buffer
+#define SPARKLINE_WIDGET(left, top, height, history) \
+  { .kind = WIDGET_SPARKLINE, .x = (left), .y = (top), .w = SPARKLINE_COLS, .h = (height), .spark = (history) }
+
+//bind new data, the widget is only marked dirty when it differs from what it shows
+void widget_set_value(Widget *widget, const char *value);
+void widget_set_list(Widget *widget, const Menu *menu, int selected);
+void widget_push_sample(Widget *widget, int16_t inside, int16_t outside);
+
+bool widgets_dirty(const Widget widgets[], int len);
+void widgets_clean(Widget widgets[], int len);
+
+//rasterize the labels into the glyph cache now instead of on the first frame they appear in
+void widgets_cache_labels(u8g2_t *target, const Widget widgets[], int len);
+
+//draw every widget when full, otherwise clear and redraw only the dirty ones
+//a sparkline that only gained samples scrolls instead, which needs a full frame buffer
+void widgets_draw(u8g2_t *target, const Widget widgets[], int len, bool full);
+
+#endif
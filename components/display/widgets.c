@@ -0,0 +1,216 @@
+#include "widgets.h"
+#include "glyph_cache.h"
+#include <string.h>
+
+#define FRAME_RADIUS 5
+
+#define TEXT_HEIGHT_HALF 4
+
+#define TRI_HALF_HEIGHT 5
+#define TRI_WIDTH 6
+#define TRI_OFFSET 3
+
+#define SPARK_MIN_SPAN 20 // tenths of a degree, a flat trend is not stretched into noise
+
+void widget_set_value(Widget *widget, const char *value){
+  if(strncmp(widget->value, value, WIDGET_VALUE_LEN - 1) != 0){
+    strncpy(widget->value, value, WIDGET_VALUE_LEN - 1);
+    widget->value[WIDGET_VALUE_LEN - 1] = '\0';
+    widget->dirty = true;
+  }
+}
+
+void widget_set_list(Widget *widget, const Menu *menu, int selected){
+  if(widget->menu != menu || widget->selected != selected){
+    widget->menu = menu;
+    widget->selected = selected;
+    widget->dirty = true;
+  }
+}
+
+static int floor_degree(int tenths){
+  return (tenths >= 0 ? tenths / 10 : (tenths - 9) / 10) * 10;
+}
+
+//whole degrees around every sample in view, so small wobbles inside them never rescale
+static void sparkline_range(const Sparkline *spark, int16_t *lo, int16_t *hi){
+  int shown = spark->count < SPARKLINE_COLS ? spark->count : SPARKLINE_COLS;
+  int min = INT16_MAX;
+  int max = INT16_MIN;
+  for(int i = 0; i < shown; i++){
+    const int16_t values[] = {spark->inside[i], spark->outside[i]};
+    for(int j = 0; j < 2; j++){
+      if(values[j] == TREND_NONE){
+        continue;
+      }
+      min = values[j] < min ? values[j] : min;
+      max = values[j] > max ? values[j] : max;
+    }
+  }
+  if(min > max){
+    *lo = 0;
+    *hi = SPARK_MIN_SPAN;
+    return;
+  }
+  *lo = floor_degree(min);
+  *hi = -floor_degree(-max);
+  if(*hi - *lo < SPARK_MIN_SPAN){
+    *hi = *lo + SPARK_MIN_SPAN;
+  }
+}
+
+void widget_push_sample(Widget *widget, int16_t inside, int16_t outside){
+  Sparkline *spark = widget->spark;
+  int slot = spark->count % SPARKLINE_COLS;
+  spark->inside[slot] = inside;
+  spark->outside[slot] = outside;
+  spark->count++;
+  spark->scrolled++;
+  int16_t lo;
+  int16_t hi;
+  sparkline_range(spark, &lo, &hi);
+  if(lo != spark->lo || hi != spark->hi){
+    spark->lo = lo;
+    spark->hi = hi;
+    spark->rescaled = true;
+  }
+  widget->dirty = true;
+}
+
+bool widgets_dirty(const Widget widgets[], int len){
+  for(int i = 0; i < len; i++){
+    if(widgets[i].dirty){
+      return true;
+    }
+  }
+  return false;
+}
+
+void widgets_clean(Widget widgets[], int len){
+  for(int i = 0; i < len; i++){
+    widgets[i].dirty = false;
+    if(widgets[i].spark != NULL){
+      widgets[i].spark->scrolled = 0;
+      widgets[i].spark->rescaled = false;
+    }
+  }
+}
+
+void widgets_cache_labels(u8g2_t *target, const Widget widgets[], int len){
+  for(int i = 0; i < len; i++){
+    if(widgets[i].kind == WIDGET_LABEL){
+      glyph_cache_add(target, widgets[i].text);
+    }
+  }
+}
+
+//one row per item, the selected one is marked with a triangle and pushed right
+static void draw_list(u8g2_t *target, const Widget *widget){
+  if(widget->menu == NULL){
+    return;
+  }
+  int rows = widget->h / WIDGET_ROW_HEIGHT;
+  for(int i = 0; i < widget->menu->len && i < rows; i++){
+    int baseline = widget->y + i * WIDGET_ROW_HEIGHT + WIDGET_ROW_ASCENT;
+    if(i == widget->selected){
+      u8g2_DrawTriangle(target,
+                        widget->x,
+                        baseline-TEXT_HEIGHT_HALF-TRI_HALF_HEIGHT,
+                        widget->x,
+                        baseline-TEXT_HEIGHT_HALF+TRI_HALF_HEIGHT,
+                        widget->x+TRI_WIDTH,
+                        baseline-TEXT_HEIGHT_HALF);
+      glyph_cache_draw_label(target, widget->x+TRI_WIDTH+TRI_OFFSET, baseline, widget->menu->items[i].name);
+    }else{
+      glyph_cache_draw_label(target, widget->x, baseline, widget->menu->items[i].name);
+    }
+  }
+}
+
+static int sparkline_y(const Widget *widget, int16_t tenths){
+  const Sparkline *spark = widget->spark;
+  return widget->y + widget->h - 1 - (tenths - spark->lo) * (widget->h - 1) / (spark->hi - spark->lo);
+}
+
+//every column depends on its own sample only, so scrolled columns stay exactly as a full redraw leaves them
+static void draw_sparkline(u8g2_t *target, const Widget *widget, int first_col){
+  const Sparkline *spark = widget->spark;
+  for(int col = first_col; col < SPARKLINE_COLS; col++){
+    int sample = spark->count - SPARKLINE_COLS + col; // the newest sample is in the last column
+    if(sample < 0){
+      continue;
+    }
+    int x = widget->x + col;
+    int16_t inside = spark->inside[sample % SPARKLINE_COLS];
+    int16_t outside = spark->outside[sample % SPARKLINE_COLS];
+    if(inside != TREND_NONE){
+      int y = sparkline_y(widget, inside);
+      u8g2_DrawVLine(target, x, y, widget->y + widget->h - y);
+    }
+    if(outside != TREND_NONE){
+      u8g2_SetDrawColor(target, 2); // xor, so the dot shows over the filled inside series
+      u8g2_DrawPixel(target, x, sparkline_y(widget, outside));
+      u8g2_SetDrawColor(target, 1);
+    }
+  }
+}
+
+//move the box n columns left in a full frame buffer, where each page of 8 rows is one byte per column
+static void scroll_left(u8g2_t *target, const Widget *widget, int n){
+  uint8_t *frame = u8g2_GetBufferPtr(target);
+  int stride = u8g2_GetBufferTileWidth(target) * 8;
+  for(int page = widget->y / 8; page < (widget->y + widget->h) / 8; page++){
+    uint8_t *row = &frame[page * stride + widget->x];
+    memmove(row, row + n, widget->w - n);
+    memset(row + widget->w - n, 0, n);
+  }
+}
+
+static void draw_widget(u8g2_t *target, const Widget *widget){
+  int baseline = widget->y + WIDGET_ROW_ASCENT;
+  switch(widget->kind){
+    case(WIDGET_FRAME):
+      u8g2_DrawRFrame(target, widget->x, widget->y, widget->w, widget->h, FRAME_RADIUS);
+      break;
+    case(WIDGET_LABEL):
+      glyph_cache_draw_label(target, widget->x, baseline, widget->text);
+      break;
+    case(WIDGET_VALUE):
+      glyph_cache_draw_text(target, widget->x, baseline, widget->value);
+      break;
+    case(WIDGET_LIST):
+      draw_list(target, widget);
+      break;
+    case(WIDGET_SPARKLINE):
+      draw_sparkline(target, widget, 0);
+      break;
+  }
+}
+
+//nothing a widget draws lands outside its box, so clearing the box on a partial redraw
+//leaves the frame exactly as a full redraw would, whatever the font does at the edges
+static void draw_clipped(u8g2_t *target, const Widget *widget){
+  u8g2_SetClipWindow(target, widget->x, widget->y, widget->x + widget->w, widget->y + widget->h);
+  draw_widget(target, widget);
+  u8g2_SetMaxClipWindow(target);
+}
+
+void widgets_draw(u8g2_t *target, const Widget widgets[], int len, bool full){
+  for(int i = 0; i < len; i++){
+    const Widget *widget = &widgets[i];
+    if(full){
+      draw_clipped(target, widget);
+    }else if(widget->kind == WIDGET_SPARKLINE && widget->dirty && !widget->spark->rescaled &&
+             widget->spark->scrolled < SPARKLINE_COLS){
+      //same scale, so the old columns only move over and the new ones are drawn
+      scroll_left(target, widget, widget->spark->scrolled);
+      draw_sparkline(target, widget, SPARKLINE_COLS - widget->spark->scrolled);
+    }else if(widget->dirty){
+      //the frame underneath still holds the old contents of the box
+      u8g2_SetDrawColor(target, 0);
+      u8g2_DrawBox(target, widget->x, widget->y, widget->w, widget->h);
+      u8g2_SetDrawColor(target, 1);
+      draw_clipped(target, widget);
+    }
+  }
+}
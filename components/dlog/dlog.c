@@ -0,0 +1,137 @@
+#include "dlog.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define RING_MASK (CONFIG_DLOG_RING_ENTRIES - 1)
+_Static_assert((CONFIG_DLOG_RING_ENTRIES & RING_MASK) == 0, "CONFIG_DLOG_RING_ENTRIES must be a power of two");
+
+typedef struct {
+  uint32_t seq; // publishes the slot, see dlog_write
+  uint32_t time_ms;
+  const char *tag;
+  const char *fmt;
+  uint32_t args[DLOG_MAX_ARGS];
+  char level;
+} DlogRecord;
+
+//bounded multi producer, single consumer ring
+//seq holds the lap of the ring a slot belongs to: for position pos the slot is free when
+//seq == LAP(pos) and holds a record once seq == LAP(pos) + 1, so zeroed memory is an empty
+//ring and records written before the drain task starts are kept
+#define LAP(pos) ((pos) & ~(uint32_t)RING_MASK)
+static DlogRecord ring[CONFIG_DLOG_RING_ENTRIES];
+static uint32_t write_pos = 0;
+static uint32_t read_pos = 0;
+static uint32_t dropped = 0;
+
+//the drain task sleeps on its notification while the ring is empty. It raises waiting
+//before its last look at the ring, so a producer that publishes after that look sees the
+//flag and wakes it, and only the first record into an empty ring pays for the notify
+static TaskHandle_t drain_task = NULL;
+static bool waiting = false;
+
+static bool ring_push(DlogTag *tag, char level, const char *fmt, int nargs, const uint32_t args[]){
+  uint32_t pos = __atomic_load_n(&write_pos, __ATOMIC_RELAXED);
+  DlogRecord *rec;
+  while(1){
+    rec = &ring[pos & RING_MASK];
+    int32_t diff = (int32_t)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) - LAP(pos));
+    if(diff == 0){
+      //slot is free, claim it
+      if(__atomic_compare_exchange_n(&write_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        break;
+      }
+    }else if(diff < 0){
+      return false; // full
+    }else{
+      pos = __atomic_load_n(&write_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  rec->time_ms = esp_log_timestamp();
+  rec->tag = tag->name;
+  rec->fmt = fmt;
+  rec->level = level;
+  for(int i = 0; i < DLOG_MAX_ARGS; i++){
+    rec->args[i] = (i < nargs) ? args[i] : 0;
+  }
+  __atomic_store_n(&rec->seq, LAP(pos) + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+//fixed one second windows, the first record of a new window reports what the last one suppressed
+static bool rate_allow(DlogTag *tag, uint32_t now_ms){
+  uint32_t start = __atomic_load_n(&tag->window_start_ms, __ATOMIC_RELAXED);
+  if(now_ms - start >= 1000 &&
+     __atomic_compare_exchange_n(&tag->window_start_ms, &start, now_ms, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    __atomic_store_n(&tag->count, 0, __ATOMIC_RELAXED);
+    uint32_t suppressed = __atomic_exchange_n(&tag->suppressed, 0, __ATOMIC_RELAXED);
+    if(suppressed > 0){
+      ring_push(tag, 'W', "%" PRIu32 " messages suppressed", 1, &suppressed);
+    }
+  }
+  if(__atomic_fetch_add(&tag->count, 1, __ATOMIC_RELAXED) < tag->max_per_sec){
+    return true;
+  }
+  __atomic_fetch_add(&tag->suppressed, 1, __ATOMIC_RELAXED);
+  return false;
+}
+
+void dlog_write(DlogTag *tag, char level, const char *fmt, int nargs, const uint32_t args[]){
+  if(!rate_allow(tag, esp_log_timestamp())){
+    return;
+  }
+  if(!ring_push(tag, level, fmt, nargs, args)){
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+  }
+  //a full ring is never empty, so the drain task is already awake to report the drop
+  __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with the fence in dlog_drain_task
+  if(__atomic_load_n(&waiting, __ATOMIC_RELAXED) && __atomic_exchange_n(&waiting, false, __ATOMIC_RELAXED)){
+    if(xPortInIsrContext()){
+      BaseType_t task_woken = pdFALSE;
+      vTaskNotifyGiveFromISR(drain_task, &task_woken);
+      portYIELD_FROM_ISR(task_woken);
+    }else{
+      xTaskNotifyGive(drain_task);
+    }
+  }
+}
+
+static bool ring_empty(){
+  DlogRecord *rec = &ring[read_pos & RING_MASK];
+  return __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != LAP(read_pos) + 1;
+}
+
+void dlog_drain_task(void *parameters){
+  drain_task = xTaskGetCurrentTaskHandle();
+  while(1){
+    //only this task reads, so read_pos needs no synchronization
+    while(!ring_empty()){ // stops when empty, or when the next record is still being written
+      DlogRecord *rec = &ring[read_pos & RING_MASK];
+      printf("%c (%" PRIu32 ") %s: ", rec->level, rec->time_ms, rec->tag);
+      printf(rec->fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+      printf("\n");
+      //hand the slot back to producers for the next lap of the ring
+      __atomic_store_n(&rec->seq, LAP(read_pos) + CONFIG_DLOG_RING_ENTRIES, __ATOMIC_RELEASE);
+      read_pos++;
+    }
+
+    uint32_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if(lost > 0){
+      printf("W (%" PRIu32 ") dlog: %" PRIu32 " records dropped, ring full\n", esp_log_timestamp(), lost);
+    }
+    //batch what arrives during the period, then sleep while the ring is empty
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_DLOG_DRAIN_PERIOD_MS));
+    __atomic_store_n(&waiting, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // either this sees the record or its producer sees waiting
+    if(ring_empty()){
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    __atomic_store_n(&waiting, false, __ATOMIC_RELAXED);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**************************************
+ * Deferred log
+ * DLOGI/DLOGW record the format string pointer and up to four integer arguments into a
+ * lock-free ring, the text is only formatted later by dlog_drain_task. Callers never block
+ * on the console. Only integer conversions (%d, %u, %x, %c, PRIu32...) are supported and
+ * %s may only be given string literals, as the arguments are printed after the call returns.
+ */
+
+//one per source file, limits how many records the file can produce each second. Files that
+//log from control paths use one in place of an esp_log TAG, so a burst of warnings is
+//dropped and counted rather than formatted on the task that hit it
+typedef struct {
+  const char *name;
+  uint32_t max_per_sec;
+  uint32_t window_start_ms;
+  uint32_t count;
+  uint32_t suppressed;
+} DlogTag;
+
+#define DLOG_TAG_INIT(tag_name, per_sec) { .name = (tag_name), .max_per_sec = (per_sec) }
+
+#define DLOG_MAX_ARGS 4
+
+void dlog_write(DlogTag *tag, char level, const char *fmt, int nargs, const uint32_t args[]);
+
+//counts the arguments of a call, up to DLOG_MAX_ARGS
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+
+//the dead printf lets the compiler check the format against the arguments, it is never called
+#define DLOG(tag, level, fmt, ...) do { \
+    if(0) printf((fmt), ##__VA_ARGS__); \
+    dlog_write(&(tag), (level), (fmt), DLOG_NARGS(__VA_ARGS__), (const uint32_t[DLOG_MAX_ARGS]){ __VA_ARGS__ }); \
+  } while(0)
+
+#define DLOGI(tag, fmt, ...) DLOG(tag, 'I', fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG(tag, 'W', fmt, ##__VA_ARGS__)
+
+void dlog_drain_task(void *parameters);
+
+#endif
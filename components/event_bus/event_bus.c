@@ -0,0 +1,198 @@
+#include "event_bus.h"
+#include "serial_cmd.h"
+#include "esp_attr.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define MAX_TOPICS CONFIG_EVENT_BUS_MAX_TOPICS
+#define MAX_SUBSCRIBERS CONFIG_EVENT_BUS_MAX_SUBSCRIBERS
+
+typedef enum {
+  SUB_CALLBACK = 0,
+  SUB_MAILBOX = 1,
+  SUB_TASK = 2,
+} SubscriberKind;
+
+typedef struct {
+  int topic;
+  SubscriberKind kind;
+  BusCallback callback;
+  void *ctx;
+  QueueHandle_t mailbox;
+  TaskHandle_t task;
+} Subscriber;
+
+typedef struct {
+  uint32_t seq; // bumped on every publish, readers compare it with the last one they saw
+  uint32_t published;
+  uint32_t dropped; // values a full mailbox missed
+} TopicState;
+
+static const BusTopicDef *topics;
+static int num_topics = 0;
+static TopicState state[MAX_TOPICS];
+
+//only ever appended to, publishers read num_subscribers once and walk that many entries
+static Subscriber subscribers[MAX_SUBSCRIBERS];
+static int num_subscribers = 0;
+
+//guards latest values and their sequence numbers, held only for a copy
+static portMUX_TYPE bus_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *policy_names[] = {"latest", "fifo", "notify"};
+
+static esp_err_t subscribe(const Subscriber *subscriber){
+  if(subscriber->topic < 0 || subscriber->topic >= num_topics){
+    return ESP_ERR_INVALID_ARG;
+  }
+  esp_err_t err = ESP_OK;
+  portENTER_CRITICAL(&bus_lock);
+  if(num_subscribers < MAX_SUBSCRIBERS){
+    subscribers[num_subscribers] = *subscriber;
+    __atomic_store_n(&num_subscribers, num_subscribers + 1, __ATOMIC_RELEASE);
+  }else{
+    err = ESP_ERR_NO_MEM;
+  }
+  portEXIT_CRITICAL(&bus_lock);
+  return err;
+}
+
+esp_err_t event_bus_subscribe_callback(int topic, BusCallback callback, void *ctx){
+  Subscriber subscriber = {
+    .topic = topic,
+    .kind = SUB_CALLBACK,
+    .callback = callback,
+    .ctx = ctx,
+  };
+  return subscribe(&subscriber);
+}
+
+esp_err_t event_bus_subscribe_mailbox(int topic, QueueHandle_t mailbox){
+  if(topic >= 0 && topic < num_topics && topics[topic].policy != BUS_FIFO){
+    return ESP_ERR_INVALID_ARG; // latest and notify topics do not queue values
+  }
+  Subscriber subscriber = {
+    .topic = topic,
+    .kind = SUB_MAILBOX,
+    .mailbox = mailbox,
+  };
+  return subscribe(&subscriber);
+}
+
+esp_err_t event_bus_subscribe_task(int topic, TaskHandle_t task){
+  Subscriber subscriber = {
+    .topic = topic,
+    .kind = SUB_TASK,
+    .task = task,
+  };
+  return subscribe(&subscriber);
+}
+
+int event_bus_publish(int topic, const void *payload){
+  const BusTopicDef *def = &topics[topic];
+  portENTER_CRITICAL(&bus_lock);
+  if(def->policy == BUS_LATEST){
+    memcpy(def->latest, payload, def->size);
+  }
+  state[topic].seq++;
+  state[topic].published++;
+  portEXIT_CRITICAL(&bus_lock);
+
+  int missed = 0;
+  int count = __atomic_load_n(&num_subscribers, __ATOMIC_ACQUIRE);
+  for(int i = 0; i < count; i++){
+    const Subscriber *subscriber = &subscribers[i];
+    if(subscriber->topic != topic){
+      continue;
+    }
+    switch(subscriber->kind){
+      case(SUB_CALLBACK):
+        subscriber->callback(topic, payload, subscriber->ctx);
+        break;
+      case(SUB_MAILBOX):
+        if(xQueueSendToBack(subscriber->mailbox, payload, 0) != pdTRUE){
+          missed++;
+        }
+        break;
+      case(SUB_TASK):
+        xTaskNotifyGive(subscriber->task);
+        break;
+    }
+  }
+  if(missed > 0){
+    __atomic_add_fetch(&state[topic].dropped, missed, __ATOMIC_RELAXED);
+  }
+  return missed;
+}
+
+int IRAM_ATTR event_bus_publish_from_isr(int topic, const void *payload, BaseType_t *task_woken){
+  const BusTopicDef *def = &topics[topic];
+  portENTER_CRITICAL_ISR(&bus_lock);
+  if(def->policy == BUS_LATEST){
+    memcpy(def->latest, payload, def->size);
+  }
+  state[topic].seq++;
+  state[topic].published++;
+  portEXIT_CRITICAL_ISR(&bus_lock);
+
+  //mailboxes first, so a task woken by its notification finds the value already queued
+  int missed = 0;
+  int count = __atomic_load_n(&num_subscribers, __ATOMIC_ACQUIRE);
+  for(int i = 0; i < count; i++){
+    if(subscribers[i].topic == topic && subscribers[i].kind == SUB_MAILBOX &&
+       xQueueSendToBackFromISR(subscribers[i].mailbox, payload, task_woken) != pdTRUE){
+      missed++;
+    }
+  }
+  for(int i = 0; i < count; i++){
+    if(subscribers[i].topic == topic && subscribers[i].kind == SUB_TASK){
+      vTaskNotifyGiveFromISR(subscribers[i].task, task_woken);
+    }
+  }
+  if(missed > 0){
+    __atomic_add_fetch(&state[topic].dropped, missed, __ATOMIC_RELAXED);
+  }
+  return missed;
+}
+
+bool event_bus_read(int topic, void *out, uint32_t *seen){
+  const BusTopicDef *def = &topics[topic];
+  configASSERT(def->policy == BUS_LATEST);
+  if(def->policy != BUS_LATEST){
+    return false; // nothing is kept to read, and an empty copy must not pass for fresh data
+  }
+  bool fresh = false;
+  portENTER_CRITICAL(&bus_lock);
+  if(state[topic].seq != *seen){
+    memcpy(out, def->latest, def->size);
+    *seen = state[topic].seq;
+    fresh = true;
+  }
+  portEXIT_CRITICAL(&bus_lock);
+  return fresh;
+}
+
+static void bus_cmd(const char *args){
+  int count = __atomic_load_n(&num_subscribers, __ATOMIC_ACQUIRE);
+  printf("%-18s %-7s %10s %8s %5s\n", "topic", "policy", "published", "dropped", "subs");
+  for(int topic = 0; topic < num_topics; topic++){
+    int subs = 0;
+    for(int i = 0; i < count; i++){
+      subs += subscribers[i].topic == topic;
+    }
+    printf("%-18s %-7s %10" PRIu32 " %8" PRIu32 " %5d\n", topics[topic].name, policy_names[topics[topic].policy],
+           state[topic].published, state[topic].dropped, subs);
+  }
+}
+
+void event_bus_init(const BusTopicDef *bus_topics, int count){
+  configASSERT(count <= MAX_TOPICS);
+  for(int topic = 0; topic < count; topic++){
+    configASSERT((bus_topics[topic].policy == BUS_LATEST) == (bus_topics[topic].latest != NULL));
+  }
+  topics = bus_topics;
+  num_topics = count;
+  serial_cmd_register("bus", "event bus topics with publish and drop counts", bus_cmd);
+}
@@ -0,0 +1,54 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+/**************************************
+ * Event bus
+ * Producers publish to a topic without knowing who is listening. Topics are declared by
+ * the application (see the manifest in main) with a payload size and a delivery policy:
+ *   BUS_LATEST  the bus keeps the newest value, readers fetch it with event_bus_read
+ *   BUS_FIFO    every value is queued to each mailbox subscriber, full mailboxes drop it
+ *   BUS_NOTIFY  nothing is kept, callbacks see the value as it is published
+ * Callbacks and task notifications work with every policy.
+ */
+
+typedef enum {
+  BUS_LATEST = 0,
+  BUS_FIFO = 1,
+  BUS_NOTIFY = 2,
+} BusPolicy;
+
+typedef struct {
+  const char *name;
+  uint16_t size; // payload bytes
+  BusPolicy policy;
+  void *latest; // storage for the newest value, BUS_LATEST only and NULL for the others
+} BusTopicDef;
+
+//runs in the publishing task and must not block
+typedef void (*BusCallback)(int topic, const void *payload, void *ctx);
+
+//topics must stay valid for the life of the program, topic ids index into this table
+void event_bus_init(const BusTopicDef *topics, int num_topics);
+
+//subscriptions are permanent, they are made during start up
+esp_err_t event_bus_subscribe_callback(int topic, BusCallback callback, void *ctx);
+esp_err_t event_bus_subscribe_mailbox(int topic, QueueHandle_t mailbox); // BUS_FIFO only, items must be the payload size
+esp_err_t event_bus_subscribe_task(int topic, TaskHandle_t task); // task notification on every publish
+
+//returns how many mailboxes were full and missed the value
+int event_bus_publish(int topic, const void *payload);
+//interrupt version, callbacks are skipped so topics published from an isr use mailboxes or tasks
+int event_bus_publish_from_isr(int topic, const void *payload, BaseType_t *task_woken);
+
+//copies the newest value of a BUS_LATEST topic if it changed since *seen, seen starts at 0
+//other topics keep no value, reading one asserts and returns false
+bool event_bus_read(int topic, void *out, uint32_t *seen);
+
+#endif
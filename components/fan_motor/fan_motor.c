@@ -2,6 +2,11 @@
 #include "board.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "dlog.h"
+#include "trace.h"
+#include "metrics.h"
+#include "power_mgmt.h"
 #include "driver/ledc.h"
 #include <stdint.h>
 
@@ -13,11 +18,13 @@
 static ledc_timer_config_t timer_config;
 static ledc_channel_config_t channel_config;
 static const char *TAG = "Fan";
+static DlogTag dlog_tag = DLOG_TAG_INIT("Fan", 10);
 
-static uint32_t current_duty;
+//user settings live in rtc memory so they survive away mode deep sleep
+static RTC_DATA_ATTR uint32_t current_duty = 0;
 
-static bool is_enabled = false;
-static bool is_auto = false;
+static RTC_DATA_ATTR bool is_enabled = true;
+static RTC_DATA_ATTR bool is_auto = false;
 static bool auto_on = false;
 
 
@@ -48,18 +55,21 @@ void fan_init(){
   ESP_LOGI(TAG, "Configuring LEDC Channel");
   ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
 
-  current_duty = 0;
-
-  is_auto = false;
-  is_enabled = true;
-
   // be sure to run ledc_fade_func_install(0); in main 
   //this allows the ledc to transition between duty cycle values smoothly
 }
 
 void update_fan_duty(uint32_t duty){
+  if(duty > 0){
+    power_mgmt_pwm_active(PM_PWM_FAN, true); // clock has to be locked before the output starts
+  }
   ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_2, duty, 0));
-  ESP_LOGI(TAG, "Fan set to %" PRIu32 " duty.", duty);
+  if(duty == 0){
+    power_mgmt_pwm_active(PM_PWM_FAN, false);
+  }
+  TRACE(TRACE_ACTUATOR_COMMIT, TRACE_FAN);
+  metric_inc(METRIC_FAN_WRITES);
+  DLOGI(dlog_tag, "Fan set to %" PRIu32 " duty.", duty);
 }
 
 //allow for the fan speed to be set with a integer value 0-100
@@ -100,25 +110,23 @@ void fan_toggle_enabled(){
   is_enabled = !is_enabled;
   // if the device is enabled 
   if(is_enabled){
-    ESP_LOGI(TAG, "Fan has been enabled");
+    DLOGI(dlog_tag, "Fan has been enabled");
     //either the device has automatically been switched on or automatic mode is off
     if(auto_on || !is_auto){
       update_fan_duty(current_duty); //update the last duty that was set by the user to the driver
     }
   }else{
-    ESP_LOGI(TAG, "Fan has been disabled");
+    DLOGI(dlog_tag, "Fan has been disabled");
     update_fan_duty(0); // push duty directly to avoid overwriting user set duty
   }
 }
 
 void fan_on(){
-  ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_2, current_duty, 0));
-  ESP_LOGI(TAG, "Fan set to %" PRIu32 " duty.", current_duty);
+  update_fan_duty(current_duty);
 }
 
 void fan_off(){
-  ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_2, 0, 0));
-  ESP_LOGI(TAG, "Fan set to 0 duty.");
+  update_fan_duty(0);
 }
 
 // if the sent in percentage is greater than the set threshold, turn the fan on, otherwise off
@@ -134,4 +142,11 @@ void fan_send_sensor_pct(uint8_t sensor_pct){
     } 
   }
   
+}
+
+//reapply the user settings after the output was parked for away mode
+void fan_resume(){
+  if(is_enabled && (auto_on || !is_auto)){
+    update_fan_duty(current_duty);
+  }
 }
\ No newline at end of file
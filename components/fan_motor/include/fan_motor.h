@@ -7,6 +7,7 @@ void fan_init();
 void fan_set_speed(uint8_t percent);
 void fan_on();
 void fan_off();
+void fan_resume();
 bool get_fan_is_auto();
 bool get_fan_is_enabled();
 void fan_toggle_auto();
@@ -0,0 +1,253 @@
+#include "heap_profiler.h"
+#include "serial_cmd.h"
+#include "metrics.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#if CONFIG_HEAP_TASK_TRACKING
+#include "esp_heap_task_info.h"
+#endif
+#if CONFIG_HEAP_TRACING_STANDALONE
+#include "esp_heap_trace.h"
+#endif
+
+#define HISTORY CONFIG_HEAP_PROFILER_HISTORY
+#define MAX_TASKS 24
+#define HEAP_CAPS MALLOC_CAP_8BIT // the heap malloc and the network stack draw from
+
+static HeapSample history[HISTORY];
+static int num_samples = 0; // total taken, the newest is at (num_samples - 1) % HISTORY
+static esp_timer_handle_t sample_timer;
+static portMUX_TYPE profile_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "Heap Profiler";
+
+/**************************************
+ * Per task usage
+ */
+
+#if CONFIG_HEAP_TASK_TRACKING
+typedef struct {
+  TaskHandle_t task; // NULL for memory allocated before the scheduler started
+  uint32_t live; // bytes held now
+  uint32_t max_sampled; // most bytes held at a sample, a burst between two samples is not seen
+  uint32_t blocks;
+} TaskHeap;
+
+static TaskHeap task_heap[MAX_TASKS];
+static int num_task_heap = 0;
+static heap_task_totals_t totals[MAX_TASKS]; // only touched by the sampling timer
+
+static void sample_tasks(){
+  size_t num_totals = 0;
+  heap_task_info_params_t params = {
+    .caps = {HEAP_CAPS},
+    .mask = {HEAP_CAPS},
+    .totals = totals,
+    .num_totals = &num_totals,
+    .max_totals = MAX_TASKS,
+  };
+  heap_caps_get_per_task_info(&params);
+
+  portENTER_CRITICAL(&profile_lock);
+  for(int i = 0; i < num_task_heap; i++){
+    task_heap[i].live = 0;
+    task_heap[i].blocks = 0;
+  }
+  for(size_t i = 0; i < num_totals; i++){
+    TaskHeap *rec = NULL;
+    for(int j = 0; j < num_task_heap && rec == NULL; j++){
+      if(task_heap[j].task == totals[i].task){
+        rec = &task_heap[j];
+      }
+    }
+    if(rec == NULL && num_task_heap < MAX_TASKS){
+      rec = &task_heap[num_task_heap++];
+      *rec = (TaskHeap){ .task = totals[i].task };
+    }
+    if(rec == NULL){
+      continue;
+    }
+    rec->live = totals[i].size[0];
+    rec->blocks = totals[i].count[0];
+    if(rec->live > rec->max_sampled){
+      rec->max_sampled = rec->live;
+    }
+  }
+  portEXIT_CRITICAL(&profile_lock);
+}
+
+//task handles of deleted tasks can still own memory, so names only come from tasks known to be alive
+static const char *task_name(TaskHandle_t task, const TaskStatus_t *alive, UBaseType_t num_alive){
+  if(task == NULL){
+    return "(start up)";
+  }
+  for(UBaseType_t i = 0; i < num_alive; i++){
+    if(alive[i].xHandle == task){
+      return alive[i].pcTaskName;
+    }
+  }
+  return "(deleted)";
+}
+
+static void report_tasks(){
+  static TaskStatus_t alive[MAX_TASKS];
+  UBaseType_t num_alive = 0;
+#if configUSE_TRACE_FACILITY
+  num_alive = uxTaskGetSystemState(alive, MAX_TASKS, NULL);
+#endif
+  TaskHeap snapshot[MAX_TASKS];
+  portENTER_CRITICAL(&profile_lock);
+  int count = num_task_heap;
+  memcpy(snapshot, task_heap, sizeof(task_heap));
+  portEXIT_CRITICAL(&profile_lock);
+
+  printf("%-16s %8s %10s %7s\n", "Task", "Live", "MaxSampled", "Blocks");
+  for(int i = 0; i < count; i++){
+    printf("%-16s %8" PRIu32 " %10" PRIu32 " %7" PRIu32 "\n", task_name(snapshot[i].task, alive, num_alive),
+           snapshot[i].live, snapshot[i].max_sampled, snapshot[i].blocks);
+  }
+}
+#else
+static void sample_tasks(){}
+
+static void report_tasks(){
+  printf("Per task figures need CONFIG_HEAP_TASK_TRACKING\n");
+}
+#endif
+
+/**************************************
+ * Free space and fragmentation
+ */
+
+void heap_profiler_sample(HeapSample *sample){
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, HEAP_CAPS);
+  sample->free_bytes = info.total_free_bytes;
+  sample->largest_free = info.largest_free_block;
+  sample->min_free = info.minimum_free_bytes;
+  sample->frag_pct = info.total_free_bytes > 0 ? 100 - (info.largest_free_block * 100) / info.total_free_bytes : 0;
+
+  metric_set(METRIC_HEAP_FREE, sample->free_bytes);
+  metric_set(METRIC_HEAP_LARGEST, sample->largest_free);
+  metric_set(METRIC_HEAP_MIN_FREE, sample->min_free);
+  metric_set(METRIC_HEAP_FRAG, sample->frag_pct);
+}
+
+static void sample_timer_cb(void *arg){
+  HeapSample sample;
+  heap_profiler_sample(&sample);
+  sample_tasks();
+  portENTER_CRITICAL(&profile_lock);
+  history[num_samples % HISTORY] = sample;
+  num_samples++;
+  portEXIT_CRITICAL(&profile_lock);
+}
+
+static void report_history(){
+  static HeapSample snapshot[HISTORY]; // can be more than the console task stack holds
+  portENTER_CRITICAL(&profile_lock);
+  int taken = num_samples;
+  memcpy(snapshot, history, sizeof(history));
+  portEXIT_CRITICAL(&profile_lock);
+
+  int count = taken < HISTORY ? taken : HISTORY;
+  printf("Last %d samples, %d s apart, oldest first\n", count, CONFIG_HEAP_PROFILER_INTERVAL_S);
+  printf("%8s %8s %8s %5s\n", "Free", "Largest", "MinFree", "Frag%");
+  for(int i = taken - count; i < taken; i++){
+    const HeapSample *sample = &snapshot[i % HISTORY];
+    printf("%8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %5u\n", sample->free_bytes, sample->largest_free,
+           sample->min_free, sample->frag_pct);
+  }
+}
+
+/**************************************
+ * Checkpoints
+ */
+
+#if CONFIG_HEAP_TRACING_STANDALONE
+static heap_trace_record_t trace_records[CONFIG_HEAP_PROFILER_TRACE_RECORDS];
+static bool trace_ready = false;
+static bool marked = false;
+static uint32_t mark_free = 0;
+
+//every allocation from here on is recorded until the matching free removes it again
+static void mark(){
+  if(!trace_ready){
+    ESP_ERROR_CHECK(heap_trace_init_standalone(trace_records, CONFIG_HEAP_PROFILER_TRACE_RECORDS));
+    trace_ready = true;
+  }
+  heap_trace_stop(); // a second mark starts over
+  HeapSample sample;
+  heap_profiler_sample(&sample);
+  mark_free = sample.free_bytes;
+  ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_LEAKS));
+  marked = true;
+  printf("Heap checkpoint set at %" PRIu32 " bytes free\n", mark_free);
+}
+
+//whatever is still recorded was allocated after the mark and never freed
+static void check(){
+  if(!marked){
+    printf("No checkpoint, use 'heap mark' first\n");
+    return;
+  }
+  heap_trace_stop();
+  marked = false;
+  heap_trace_summary_t summary;
+  heap_trace_summary(&summary);
+  HeapSample sample;
+  heap_profiler_sample(&sample);
+  heap_trace_dump();
+  printf("Since the checkpoint: %" PRIu32 " allocations, %" PRIu32 " frees, %" PRIu32 " unmatched, free space %+" PRId32 " bytes\n",
+         (uint32_t)summary.total_allocations, (uint32_t)summary.total_frees, (uint32_t)summary.count,
+         (int32_t)(sample.free_bytes - mark_free));
+  if(summary.has_overflowed){
+    printf("Trace buffer overflowed, raise CONFIG_HEAP_PROFILER_TRACE_RECORDS for a complete list\n");
+  }
+}
+#else
+static void mark(){
+  printf("Checkpoints need CONFIG_HEAP_TRACING_STANDALONE\n");
+}
+
+static void check(){
+  mark();
+}
+#endif
+
+static void heap_cmd(const char *args){
+  if(strcmp(args, "mark") == 0){
+    mark();
+  }else if(strcmp(args, "check") == 0){
+    check();
+  }else{
+    HeapSample sample;
+    heap_profiler_sample(&sample);
+    printf("Free %" PRIu32 ", largest block %" PRIu32 ", min free %" PRIu32 ", fragmentation %u%%\n",
+           sample.free_bytes, sample.largest_free, sample.min_free, sample.frag_pct);
+    report_history();
+    report_tasks();
+  }
+}
+
+void heap_profiler_init(){
+  const esp_timer_create_args_t timer_args = {
+    .callback = sample_timer_cb,
+    .name = "heap profiler",
+    .skip_unhandled_events = true,
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &sample_timer));
+  ESP_ERROR_CHECK(esp_timer_start_periodic(sample_timer, (uint64_t)CONFIG_HEAP_PROFILER_INTERVAL_S * 1000000));
+  serial_cmd_register("heap", "heap use per task and fragmentation history, 'heap mark' and 'heap check' list allocations not freed in between", heap_cmd);
+  ESP_LOGI(TAG, "Sampling every %d s", CONFIG_HEAP_PROFILER_INTERVAL_S);
+}
@@ -0,0 +1,33 @@
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/**************************************
+ * Heap profiler
+ * Samples free space, the largest free block and fragmentation on a timer, and with
+ * CONFIG_HEAP_TASK_TRACKING the bytes held by every task. The per task maximum is the
+ * largest of those samples rather than a high water mark, a burst that comes and goes
+ * between two samples does not show in it. Between a "heap mark" and a "heap check"
+ * every allocation is traced, and the ones still live at the check are printed with
+ * their callers (needs CONFIG_HEAP_TRACING_STANDALONE).
+ */
+
+typedef struct {
+  uint32_t free_bytes;
+  uint32_t largest_free; // biggest single allocation that would succeed
+  uint32_t min_free; // lowest free space since boot
+  uint8_t frag_pct; // share of free space outside the largest block
+} HeapSample;
+
+#if CONFIG_DESK_DIAGNOSTICS
+void heap_profiler_init(); // starts sampling and registers the "heap" console command
+void heap_profiler_sample(HeapSample *sample); // take a sample now, also updates the heap metrics
+#else
+//only the telemetry profile has the profiler
+static inline void heap_profiler_init(){}
+static inline void heap_profiler_sample(HeapSample *sample){ *sample = (HeapSample){0}; }
+#endif
+
+#endif
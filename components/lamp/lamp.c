@@ -3,6 +3,11 @@
 #include "driver/ledc.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "dlog.h"
+#include "trace.h"
+#include "metrics.h"
+#include "power_mgmt.h"
 #include <inttypes.h>
 
 
@@ -16,10 +21,12 @@
 static ledc_timer_config_t timer_config;
 static ledc_channel_config_t channel_config;
 static const char *TAG = "Lamp";
+static DlogTag dlog_tag = DLOG_TAG_INIT("Lamp", 10);
 
-static uint32_t current_duty;
-static bool is_enabled = false;
-static bool is_auto = false;
+//user settings live in rtc memory so they survive away mode deep sleep
+static RTC_DATA_ATTR uint32_t current_duty = 0;
+static RTC_DATA_ATTR bool is_enabled = true;
+static RTC_DATA_ATTR bool is_auto = false;
 static bool auto_on = false;
 
 void lamp_init(){
@@ -49,9 +56,6 @@ void lamp_init(){
   ESP_LOGI(TAG, "Configuring LEDC Channel");
   ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
 
-  current_duty = 0;
-  is_enabled = true;
-  is_auto = false;
 
   // be sure to run ledc_fade_func_install(0); in main
   //this allows the ledc to transition between duty cycle values smoothly
@@ -59,8 +63,16 @@ void lamp_init(){
 }
 
 void update_lamp_duty(uint32_t duty){
-  ESP_LOGI(TAG, "Lamp set to %" PRIu32 " duty.", duty);
+  DLOGI(dlog_tag, "Lamp set to %" PRIu32 " duty.", duty);
+  if(duty > 0){
+    power_mgmt_pwm_active(PM_PWM_LAMP, true); // clock has to be locked before the output starts
+  }
   ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty, 0));
+  if(duty == 0){
+    power_mgmt_pwm_active(PM_PWM_LAMP, false);
+  }
+  TRACE(TRACE_ACTUATOR_COMMIT, TRACE_LAMP);
+  metric_inc(METRIC_LAMP_WRITES);
 }
 
 //set brightness using a int from 0-100 (%)
@@ -97,28 +109,25 @@ void lamp_toggle_auto(){
 void lamp_toggle_enabled(){
   is_enabled = !is_enabled;
   if(is_enabled){
-    ESP_LOGI(TAG, "Lamp has been enabled");
+    DLOGI(dlog_tag, "Lamp has been enabled");
     //either the device has automatically been switched on or automatic mode is off
     if(auto_on || !is_auto){
       update_lamp_duty(current_duty); //update the last duty that was set by the user to the driver
     }
   }else{
-    ESP_LOGI(TAG, "Lamp has been disabled");
+    DLOGI(dlog_tag, "Lamp has been disabled");
     update_lamp_duty(0); // push duty directly to avoid overwriting user set duty
   }
 }
 
 //turn lamp on from the stored duty cycle
 void lamp_on(){
-  ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, current_duty, 0));
-  ESP_LOGI(TAG, "Lamp set to %" PRIu32 " duty.", current_duty);
-  
+  update_lamp_duty(current_duty);
 }
 
 //turn lamp off by setting duty to 0
 void lamp_off(){
-  ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0, 0));
-  ESP_LOGI(TAG, "Lamp set to 0 duty.");
+  update_lamp_duty(0);
 }
 
 
@@ -135,4 +144,11 @@ void lamp_send_sensor_pct(uint8_t sensor_pct){
     } 
   }
   
+}
+
+//reapply the user settings after the output was parked for away mode
+void lamp_resume(){
+  if(is_enabled && (auto_on || !is_auto)){
+    update_lamp_duty(current_duty);
+  }
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "driver/gpio.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "trace.h"
+#include "metrics.h"
 #include "board.h"
 #include <stdint.h>
 
@@ -62,6 +64,8 @@ void set_level_indicator(int lvl){
   gpio_set_level(LATCH, 0);
   spi_device_transmit(spi_handle, &t);
   gpio_set_level(LATCH, 1);
+  TRACE(TRACE_ACTUATOR_COMMIT, TRACE_LEVEL);
+  metric_inc(METRIC_LEVEL_WRITES);
 
 }
 
@@ -0,0 +1,101 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+/**************************************
+ * Metric registry
+ * Every metric is declared here so all storage is static and ids are compile time constants.
+ * Updates are single atomic operations and safe from any task or ISR.
+ */
+
+//X(id, name)
+#define METRIC_COUNTERS(X) \
+  X(METRIC_BUTTON_DROPPED,   "ring.button.dropped") \
+  X(METRIC_POT_DROPPED,      "queue.pot.dropped") \
+  X(METRIC_PHOTO_DROPPED,    "queue.photo.dropped") \
+  X(METRIC_TEMP_DROPPED,     "queue.temp.dropped") \
+  X(METRIC_HTTP_FAILED,      "http.failed") \
+  X(METRIC_FAN_WRITES,       "actuator.fan.writes") \
+  X(METRIC_VENT_WRITES,      "actuator.vent.writes") \
+  X(METRIC_LAMP_WRITES,      "actuator.lamp.writes") \
+  X(METRIC_LEVEL_WRITES,     "actuator.level.writes") \
+  X(METRIC_WEATHER_DROPPED,  "queue.weather.dropped") \
+  X(METRIC_RULES_FIRED,      "rules.fired") \
+  X(METRIC_SCHEDULE_DROPPED, "queue.schedule.dropped") \
+  X(METRIC_POT_TICK_DROPPED, "ring.pot.dropped") \
+  X(METRIC_DEADLINE_MISSED,  "supervisor.deadline_missed") \
+  X(METRIC_SUBSYSTEM_RESTARTS, "supervisor.restarts") \
+  X(METRIC_DISPLAY_TILES_SENT, "display.tiles_sent") \
+  X(METRIC_DISPLAY_FRAMES_DROPPED, "display.frames_dropped")
+
+//X(id, name)
+#define METRIC_GAUGES(X) \
+  X(METRIC_CONTROLLER_DEPTH, "queue.controller.depth") \
+  X(METRIC_INSIDE_TEMP,      "sensor.temp.inside") \
+  X(METRIC_OUTSIDE_TEMP,     "weather.temp.outside") \
+  X(METRIC_HEAP_FREE,        "heap.free") \
+  X(METRIC_HEAP_LARGEST,     "heap.largest_free") \
+  X(METRIC_HEAP_MIN_FREE,    "heap.min_free") \
+  X(METRIC_HEAP_FRAG,        "heap.frag_pct")
+
+//X(id, name), all histograms record durations in microseconds
+#define METRIC_HISTOGRAMS(X) \
+  X(METRIC_ADC_READ_US,      "adc.read_us") \
+  X(METRIC_DISPLAY_FLUSH_US, "display.flush_us") \
+  X(METRIC_DISPLAY_DRAW_US,  "display.draw_us") \
+  X(METRIC_HTTP_FETCH_US,    "http.fetch_us") \
+  X(METRIC_RULES_EVAL_US,    "rules.eval_us") \
+  X(METRIC_BUTTON_LATENCY_US, "ui.button_latency_us") \
+  X(METRIC_POT_LATENCY_US,   "pot.sample_latency_us") \
+  X(METRIC_CONTROLLER_LATENCY_US, "controller.latency_us")
+
+#define METRIC_ID(id, name) id,
+typedef enum { METRIC_COUNTERS(METRIC_ID) METRIC_NUM_COUNTERS } MetricCounter;
+typedef enum { METRIC_GAUGES(METRIC_ID) METRIC_NUM_GAUGES } MetricGauge;
+typedef enum { METRIC_HISTOGRAMS(METRIC_ID) METRIC_NUM_HISTOGRAMS } MetricHistogram;
+#undef METRIC_ID
+
+//upper bounds of the histogram buckets in us, the last bucket catches everything above
+#define METRIC_BUCKET_BOUNDS_US {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000, 5000000}
+#define METRIC_NUM_BUCKETS 14
+
+typedef struct {
+  uint32_t buckets[METRIC_NUM_BUCKETS];
+  uint32_t count;
+  uint32_t sum_us; // wraps after about 71 minutes of total recorded time
+  uint32_t max_us;
+} MetricHistogramData;
+
+extern uint32_t metric_counters[METRIC_NUM_COUNTERS];
+extern int32_t metric_gauges[METRIC_NUM_GAUGES];
+extern MetricHistogramData metric_histograms[METRIC_NUM_HISTOGRAMS];
+extern const uint32_t metric_bucket_bounds[METRIC_NUM_BUCKETS - 1];
+
+static inline void metric_add(MetricCounter id, uint32_t n){
+  __atomic_fetch_add(&metric_counters[id], n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_inc(MetricCounter id){
+  metric_add(id, 1);
+}
+
+static inline void metric_set(MetricGauge id, int32_t value){
+  __atomic_store_n(&metric_gauges[id], value, __ATOMIC_RELAXED);
+}
+
+void metric_observe(MetricHistogram id, uint32_t duration_us);
+void metric_record(MetricHistogramData *hist, uint32_t duration_us); // for histograms kept outside the registry
+uint32_t metric_percentile_us(const MetricHistogramData *hist, int pct); // upper bound of the bucket it falls in
+
+typedef struct {
+  uint32_t counters[METRIC_NUM_COUNTERS];
+  int32_t gauges[METRIC_NUM_GAUGES];
+  MetricHistogramData histograms[METRIC_NUM_HISTOGRAMS];
+} MetricsSnapshot;
+
+void metrics_init(); // registers the metrics console command
+void metrics_snapshot(MetricsSnapshot *snapshot);
+void metrics_dump(); // print a compact snapshot, one metric per line
+
+#endif
@@ -0,0 +1,103 @@
+#include "metrics.h"
+#include "serial_cmd.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+uint32_t metric_counters[METRIC_NUM_COUNTERS];
+int32_t metric_gauges[METRIC_NUM_GAUGES];
+MetricHistogramData metric_histograms[METRIC_NUM_HISTOGRAMS];
+const uint32_t metric_bucket_bounds[METRIC_NUM_BUCKETS - 1] = METRIC_BUCKET_BOUNDS_US;
+
+#define METRIC_NAME(id, name) name,
+static const char *counter_names[METRIC_NUM_COUNTERS] = { METRIC_COUNTERS(METRIC_NAME) };
+static const char *gauge_names[METRIC_NUM_GAUGES] = { METRIC_GAUGES(METRIC_NAME) };
+static const char *histogram_names[METRIC_NUM_HISTOGRAMS] = { METRIC_HISTOGRAMS(METRIC_NAME) };
+#undef METRIC_NAME
+
+void metric_observe(MetricHistogram id, uint32_t duration_us){
+  metric_record(&metric_histograms[id], duration_us);
+}
+
+void metric_record(MetricHistogramData *hist, uint32_t duration_us){
+  int bucket = 0;
+  while(bucket < METRIC_NUM_BUCKETS - 1 && duration_us > metric_bucket_bounds[bucket]){
+    bucket++;
+  }
+  __atomic_fetch_add(&hist->buckets[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->sum_us, duration_us, __ATOMIC_RELAXED);
+
+  uint32_t max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+  while(duration_us > max &&
+        !__atomic_compare_exchange_n(&hist->max_us, &max, duration_us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    //max was reloaded by the failed exchange, try again
+  }
+}
+
+//capped at the largest value seen, so a percentile in the last bucket is still a number
+uint32_t metric_percentile_us(const MetricHistogramData *hist, int pct){
+  uint32_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+  uint32_t max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+  uint32_t rank = ((uint64_t)count * pct + 99) / 100;
+  uint32_t seen = 0;
+  for(int b = 0; b < METRIC_NUM_BUCKETS - 1; b++){
+    seen += __atomic_load_n(&hist->buckets[b], __ATOMIC_RELAXED);
+    if(seen >= rank){
+      return metric_bucket_bounds[b] < max ? metric_bucket_bounds[b] : max;
+    }
+  }
+  return max;
+}
+
+//each value is read atomically, the snapshot as a whole is not taken at a single instant
+void metrics_snapshot(MetricsSnapshot *snapshot){
+  for(int i = 0; i < METRIC_NUM_COUNTERS; i++){
+    snapshot->counters[i] = __atomic_load_n(&metric_counters[i], __ATOMIC_RELAXED);
+  }
+  for(int i = 0; i < METRIC_NUM_GAUGES; i++){
+    snapshot->gauges[i] = __atomic_load_n(&metric_gauges[i], __ATOMIC_RELAXED);
+  }
+  for(int i = 0; i < METRIC_NUM_HISTOGRAMS; i++){
+    MetricHistogramData *src = &metric_histograms[i];
+    MetricHistogramData *dst = &snapshot->histograms[i];
+    for(int b = 0; b < METRIC_NUM_BUCKETS; b++){
+      dst->buckets[b] = __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+    }
+    dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum_us = __atomic_load_n(&src->sum_us, __ATOMIC_RELAXED);
+    dst->max_us = __atomic_load_n(&src->max_us, __ATOMIC_RELAXED);
+  }
+}
+
+// c <name> <value>
+// g <name> <value>
+// h <name> <count> <sum_us> <max_us> <bucket counts...>
+void metrics_dump(){
+  static MetricsSnapshot snap; //only touched by the console task, kept off its stack
+  metrics_snapshot(&snap);
+
+  for(int i = 0; i < METRIC_NUM_COUNTERS; i++){
+    printf("c %s %" PRIu32 "\n", counter_names[i], snap.counters[i]);
+  }
+  for(int i = 0; i < METRIC_NUM_GAUGES; i++){
+    printf("g %s %" PRId32 "\n", gauge_names[i], snap.gauges[i]);
+  }
+  for(int i = 0; i < METRIC_NUM_HISTOGRAMS; i++){
+    MetricHistogramData *hist = &snap.histograms[i];
+    printf("h %s %" PRIu32 " %" PRIu32 " %" PRIu32, histogram_names[i], hist->count, hist->sum_us, hist->max_us);
+    for(int b = 0; b < METRIC_NUM_BUCKETS; b++){
+      printf(" %" PRIu32, hist->buckets[b]);
+    }
+    printf("\n");
+  }
+}
+
+static void metrics_cmd(const char *args){
+  metrics_dump();
+}
+
+void metrics_init(){
+  serial_cmd_register("metrics", "dump counters, gauges and latency histograms", metrics_cmd);
+}
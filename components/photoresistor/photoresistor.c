@@ -6,6 +6,7 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "dlog.h"
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -19,7 +20,7 @@
 //adc variables
 static adc_channel_t adc_channel_6;
 
-static char *TAG = "Photoresistor";
+static DlogTag dlog_tag = DLOG_TAG_INIT("Photoresistor", 5);
 
 void photoresistor_init(){
   adc_channel_6 = ADC_CHANNEL_6;
@@ -30,7 +31,7 @@ void photoresistor_init(){
 
 int read_photo_vltg(){
   int reading = read_vltg_from_channel(adc_channel_6);
-  ESP_LOGI(TAG, "Photoresistor reads value of %dmV", reading);
+  DLOGI(dlog_tag, "Photoresistor reads value of %dmV", reading);
   return reading;
 }
 
@@ -5,6 +5,7 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "dlog.h"
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -19,7 +20,7 @@ static adc_channel_t adc_channel_4;
 
 gptimer_handle_t pot_timer;
 
-static char *TAG = "Potentiometer";
+static DlogTag dlog_tag = DLOG_TAG_INIT("Potentiometer", 5);
 
 void potentiometer_init(){
   adc_channel_4 = ADC_CHANNEL_4;
@@ -58,7 +59,7 @@ int invert_reading(int vltg){
 //returns the raw reading of the potentiometer
 int read_pot_vltg(){
   int reading = read_vltg_from_channel(adc_channel_4);
-  ESP_LOGI(TAG, "Photentiometer reads value of %dmV", reading);
+  DLOGI(dlog_tag, "Photentiometer reads value of %dmV", reading);
 
   //invert the voltage reading 
   reading = invert_reading(reading);
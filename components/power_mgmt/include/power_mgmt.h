@@ -0,0 +1,47 @@
+#ifndef POWER_MGMT_H
+#define POWER_MGMT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#if CONFIG_POWER_MGMT_LIGHT_SLEEP
+#include "hal/gpio_ll.h"
+#endif
+
+//peripherals that need a fixed clock while they are in use
+typedef enum {
+  PM_ADC = 0, // sampling, holds the APB frequency
+  PM_DISPLAY = 1, // i2c flushes, holds the APB frequency
+  PM_WIFI = 2, // http requests, holds the CPU frequency so requests finish quickly
+  PM_NUM_DOMAINS = 3,
+} PmDomain;
+
+//ledc outputs, each holds the APB frequency and blocks light sleep while it is generating pwm
+typedef enum {
+  PM_PWM_FAN = 0,
+  PM_PWM_VENT = 1,
+  PM_PWM_LAMP = 2,
+  PM_NUM_PWM = 3,
+} PmPwmChannel;
+
+void power_mgmt_init(); // call before any peripheral is initialized
+void power_mgmt_acquire(PmDomain domain);
+void power_mgmt_release(PmDomain domain);
+void power_mgmt_pwm_active(PmPwmChannel channel, bool active);
+void power_mgmt_gpio_wakeup(uint8_t pin); // allow a low level on pin to wake the chip from light sleep
+void power_mgmt_report(); // lock usage and, with CONFIG_POWER_MGMT_MEASURE, time spent in each mode
+
+//gpio wake only works with level interrupts, so a wake pin waits for low, then for high, and so on
+//call first thing in the pin's isr, returns true for a press and false for a release
+static inline bool power_mgmt_gpio_wake_pressed(uint8_t pin){
+#if CONFIG_POWER_MGMT_LIGHT_SLEEP
+  bool pressed = GPIO.pin[pin].int_type == GPIO_INTR_LOW_LEVEL;
+  gpio_ll_set_intr_type(&GPIO, pin, pressed ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+  return pressed;
+#else
+  return true; // pins keep their edge interrupts
+#endif
+}
+
+#endif
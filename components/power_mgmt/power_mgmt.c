@@ -0,0 +1,111 @@
+#include "power_mgmt.h"
+#include "serial_cmd.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+
+static const char *TAG = "Power";
+
+#if CONFIG_POWER_MGMT_ENABLE
+
+static esp_pm_lock_handle_t domain_locks[PM_NUM_DOMAINS];
+static esp_pm_lock_handle_t pwm_apb_lock;
+static esp_pm_lock_handle_t pwm_sleep_lock;
+static bool pwm_active[PM_NUM_PWM];
+
+static void create_lock(esp_pm_lock_type_t type, const char *name, esp_pm_lock_handle_t *handle){
+  ESP_ERROR_CHECK(esp_pm_lock_create(type, 0, name, handle));
+}
+
+static void power_cmd(const char *args){
+  power_mgmt_report();
+}
+
+void power_mgmt_init(){
+  esp_pm_config_t config = {
+    .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+    .min_freq_mhz = CONFIG_POWER_MGMT_MIN_FREQ_MHZ,
+#if CONFIG_POWER_MGMT_LIGHT_SLEEP
+    .light_sleep_enable = true,
+#else
+    .light_sleep_enable = false,
+#endif
+  };
+  ESP_LOGI(TAG, "Configuring DFS %d-%d MHz, light sleep %s", config.min_freq_mhz, config.max_freq_mhz,
+           config.light_sleep_enable ? "on" : "off");
+  ESP_ERROR_CHECK(esp_pm_configure(&config));
+
+  create_lock(ESP_PM_APB_FREQ_MAX, "adc", &domain_locks[PM_ADC]);
+  create_lock(ESP_PM_APB_FREQ_MAX, "display", &domain_locks[PM_DISPLAY]);
+  create_lock(ESP_PM_CPU_FREQ_MAX, "wifi", &domain_locks[PM_WIFI]);
+  //ledc runs from the apb clock, which stops in light sleep and changes with dfs
+  create_lock(ESP_PM_APB_FREQ_MAX, "pwm", &pwm_apb_lock);
+  create_lock(ESP_PM_NO_LIGHT_SLEEP, "pwm sleep", &pwm_sleep_lock);
+
+  serial_cmd_register("power", "power management lock and mode statistics", power_cmd);
+}
+
+void power_mgmt_acquire(PmDomain domain){
+  esp_pm_lock_acquire(domain_locks[domain]);
+}
+
+void power_mgmt_release(PmDomain domain){
+  esp_pm_lock_release(domain_locks[domain]);
+}
+
+//pm locks are counting, so each active channel holds one reference
+void power_mgmt_pwm_active(PmPwmChannel channel, bool active){
+  //exchange so two tasks changing the same channel cannot both take or drop its reference
+  if(__atomic_exchange_n(&pwm_active[channel], active, __ATOMIC_RELAXED) == active){
+    return;
+  }
+  if(active){
+    esp_pm_lock_acquire(pwm_apb_lock);
+    esp_pm_lock_acquire(pwm_sleep_lock);
+  }else{
+    esp_pm_lock_release(pwm_sleep_lock);
+    esp_pm_lock_release(pwm_apb_lock);
+  }
+}
+
+void power_mgmt_gpio_wakeup(uint8_t pin){
+#if CONFIG_POWER_MGMT_LIGHT_SLEEP
+  ESP_ERROR_CHECK(gpio_wakeup_enable(pin, GPIO_INTR_LOW_LEVEL));
+  ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+#endif
+}
+
+void power_mgmt_report(){
+#if !CONFIG_PM_PROFILING
+  printf("Enable CONFIG_POWER_MGMT_MEASURE for time spent in each mode\n");
+#endif
+  esp_pm_dump_locks(stdout);
+}
+
+#else
+
+void power_mgmt_init(){
+  ESP_LOGI(TAG, "Power management disabled");
+}
+
+void power_mgmt_acquire(PmDomain domain){
+}
+
+void power_mgmt_release(PmDomain domain){
+}
+
+void power_mgmt_pwm_active(PmPwmChannel channel, bool active){
+}
+
+void power_mgmt_gpio_wakeup(uint8_t pin){
+}
+
+void power_mgmt_report(){
+  printf("Power management disabled\n");
+}
+
+#endif
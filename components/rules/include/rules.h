@@ -0,0 +1,57 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdint.h>
+
+/**************************************
+ * Automation rules
+ * Rules are written as "if <condition> then <actuator> <percent>", for example
+ *   if inside > 27 and outside < inside then vent 60
+ * and compiled to bytecode for a small stack machine. Conditions support integers,
+ * the inputs below, + -, > < >= <= == !=, and, or, not and parentheses.
+ * A rule fires once each time its condition becomes true.
+ */
+
+//X(id, name)
+#define RULE_INPUTS(X) \
+  X(RULE_IN_INSIDE,  "inside")  /* inside temperature in C */ \
+  X(RULE_IN_OUTSIDE, "outside") /* outside temperature in C from the weather service */ \
+  X(RULE_IN_LIGHT,   "light")   /* photoresistor, 0 for light and 100 for dark */ \
+  X(RULE_IN_TEMP,    "temp")    /* temperature sensor as a percentage */ \
+  X(RULE_IN_HOUR,    "hour")    /* local hour, only known once the clock is set */
+
+//X(id, name)
+#define RULE_TARGETS(X) \
+  X(RULE_FAN,  "fan") \
+  X(RULE_VENT, "vent") \
+  X(RULE_LAMP, "lamp")
+
+#define RULE_ID(id, name) id,
+typedef enum { RULE_INPUTS(RULE_ID) RULE_NUM_INPUTS } RuleInput;
+typedef enum { RULE_TARGETS(RULE_ID) RULE_NUM_TARGETS } RuleTarget;
+#undef RULE_ID
+
+//current sensor values, a rule that uses an input that has not been set yet is false
+typedef struct {
+  int32_t values[RULE_NUM_INPUTS];
+  uint32_t known; // bit per input
+} RuleSnapshot;
+
+static inline void rule_snapshot_set(RuleSnapshot *snapshot, RuleInput input, int32_t value){
+  snapshot->values[input] = value;
+  snapshot->known |= 1u << input;
+}
+
+typedef struct {
+  RuleTarget target;
+  uint8_t pct;
+} RuleAction;
+
+void rules_init(); // registers the "rule" console command
+void rules_load(); // compile the rules saved in nvs, nvs must already be initialized
+
+//run every rule against the snapshot and return the actions of rules that just became true
+//does not allocate and runs at most CONFIG_RULES_MAX * CONFIG_RULES_MAX_CODE_BYTES steps
+int rules_evaluate(const RuleSnapshot *snapshot, RuleAction actions[], int max_actions);
+
+#endif
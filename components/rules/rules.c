@@ -0,0 +1,465 @@
+#include "rules.h"
+#include "serial_cmd.h"
+#include "metrics.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RULES CONFIG_RULES_MAX
+#define MAX_CODE CONFIG_RULES_MAX_CODE_BYTES
+#define MAX_TEXT 80 // source of one rule, kept for listing and saving
+#define MAX_STACK 8 // enforced by the compiler, so the vm never checks it
+#define MAX_NESTING 8 // brackets and nots, each level recurses through the whole grammar on the console's stack
+#define NVS_NAMESPACE "rules"
+#define NVS_KEY "src"
+
+typedef enum {
+  OP_CONST = 0, // followed by a little endian int16
+  OP_INPUT = 1, // followed by the input id
+  OP_ADD = 2,
+  OP_SUB = 3,
+  OP_GT = 4,
+  OP_LT = 5,
+  OP_GE = 6,
+  OP_LE = 7,
+  OP_EQ = 8,
+  OP_NE = 9,
+  OP_AND = 10,
+  OP_OR = 11,
+  OP_NOT = 12,
+} RuleOp;
+
+typedef struct {
+  uint8_t code[MAX_CODE];
+  uint8_t len;
+  RuleTarget target;
+  uint8_t pct;
+  uint32_t inputs; // bit per input the condition reads
+  bool was_true;
+  char text[MAX_TEXT];
+} Rule;
+
+typedef struct {
+  const char *pos;
+  char tok[12];
+  Rule *rule;
+  int depth;
+  int nesting; // open brackets and nots around the current term
+  const char *error; // first error only
+} Parser;
+
+#define RULE_NAME(id, name) name,
+static const char *input_names[RULE_NUM_INPUTS] = {RULE_INPUTS(RULE_NAME)};
+static const char *target_names[RULE_NUM_TARGETS] = {RULE_TARGETS(RULE_NAME)};
+#undef RULE_NAME
+
+static const struct {
+  const char *tok;
+  RuleOp op;
+} compare_ops[] = {
+  {">", OP_GT}, {"<", OP_LT}, {">=", OP_GE}, {"<=", OP_LE}, {"==", OP_EQ}, {"!=", OP_NE},
+};
+
+//the controller evaluates while the console edits, the lock is only held for table copies and evaluation
+static Rule rules[MAX_RULES];
+static int num_rules = 0;
+static portMUX_TYPE rules_lock = portMUX_INITIALIZER_UNLOCKED;
+static char save_buf[MAX_RULES * MAX_TEXT + 1];
+
+static const char *TAG = "Rules";
+
+/**************************************
+ * Compiler
+ * Recursive descent straight to stack machine code, lowest precedence first:
+ * or, and, not, comparisons, + -, then numbers, inputs and parentheses.
+ */
+
+static void fail(Parser *p, const char *error){
+  if(p->error == NULL){
+    p->error = error;
+  }
+}
+
+static void next(Parser *p){
+  while(isspace((unsigned char)*p->pos)){
+    p->pos++;
+  }
+  const char *start = p->pos;
+  if(isalpha((unsigned char)*p->pos)){
+    while(isalpha((unsigned char)*p->pos)) p->pos++;
+  }else if(isdigit((unsigned char)*p->pos)){
+    while(isdigit((unsigned char)*p->pos)) p->pos++;
+  }else if(strchr("<>=!", *p->pos) != NULL && *p->pos != '\0' && p->pos[1] == '='){
+    p->pos += 2;
+  }else if(*p->pos != '\0'){
+    p->pos++;
+  }
+  int len = p->pos - start;
+  if(len >= sizeof(p->tok)){
+    fail(p, "word too long");
+    len = sizeof(p->tok) - 1;
+  }
+  for(int i = 0; i < len; i++){
+    p->tok[i] = tolower((unsigned char)start[i]);
+  }
+  p->tok[len] = '\0';
+}
+
+static bool accept(Parser *p, const char *tok){
+  if(strcmp(p->tok, tok) == 0){
+    next(p);
+    return true;
+  }
+  return false;
+}
+
+static void emit(Parser *p, uint8_t byte){
+  if(p->rule->len >= MAX_CODE){
+    fail(p, "rule too long");
+    return;
+  }
+  p->rule->code[p->rule->len++] = byte;
+}
+
+//track the stack depth the code will reach so the vm can use a fixed stack
+static void push(Parser *p){
+  if(++p->depth > MAX_STACK){
+    fail(p, "condition nested too deeply");
+  }
+}
+
+//false once the condition is nested past what the stack allows for, or anything failed
+//before recursing, so neither a deep nor a broken condition costs more stack
+static bool enter(Parser *p){
+  if(++p->nesting > MAX_NESTING){
+    fail(p, "condition nested too deeply");
+  }
+  return p->error == NULL;
+}
+
+static void or_expr(Parser *p);
+
+static void term(Parser *p){
+  bool negative = accept(p, "-");
+  if(isdigit((unsigned char)p->tok[0])){
+    long value = strtol(p->tok, NULL, 10) * (negative ? -1 : 1);
+    if(value < INT16_MIN || value > INT16_MAX){
+      fail(p, "number out of range");
+    }
+    emit(p, OP_CONST);
+    emit(p, (uint16_t)value & 0xff);
+    emit(p, (uint16_t)value >> 8);
+    push(p);
+    next(p);
+    return;
+  }
+  if(negative){
+    fail(p, "expected a number after -");
+    return;
+  }
+  if(accept(p, "(")){
+    if(enter(p)){
+      or_expr(p);
+    }
+    p->nesting--;
+    if(!accept(p, ")")){
+      fail(p, "missing )");
+    }
+    return;
+  }
+  for(int i = 0; i < RULE_NUM_INPUTS; i++){
+    if(strcmp(p->tok, input_names[i]) == 0){
+      emit(p, OP_INPUT);
+      emit(p, i);
+      p->rule->inputs |= 1u << i;
+      push(p);
+      next(p);
+      return;
+    }
+  }
+  fail(p, "expected a number, input or (");
+}
+
+static void sum(Parser *p){
+  term(p);
+  while(1){
+    RuleOp op;
+    if(accept(p, "+")){
+      op = OP_ADD;
+    }else if(accept(p, "-")){
+      op = OP_SUB;
+    }else{
+      return;
+    }
+    term(p);
+    emit(p, op);
+    p->depth--;
+  }
+}
+
+static void compare(Parser *p){
+  sum(p);
+  for(int i = 0; i < sizeof(compare_ops) / sizeof(compare_ops[0]); i++){
+    if(accept(p, compare_ops[i].tok)){
+      sum(p);
+      emit(p, compare_ops[i].op);
+      p->depth--;
+      return;
+    }
+  }
+}
+
+static void not_expr(Parser *p){
+  if(accept(p, "not")){
+    if(enter(p)){
+      not_expr(p);
+    }
+    p->nesting--;
+    emit(p, OP_NOT);
+  }else{
+    compare(p);
+  }
+}
+
+static void and_expr(Parser *p){
+  not_expr(p);
+  while(accept(p, "and")){
+    not_expr(p);
+    emit(p, OP_AND);
+    p->depth--;
+  }
+}
+
+static void or_expr(Parser *p){
+  and_expr(p);
+  while(accept(p, "or")){
+    and_expr(p);
+    emit(p, OP_OR);
+    p->depth--;
+  }
+}
+
+//compile "if <condition> then <actuator> <percent>", returns NULL or what was wrong
+static const char *compile(const char *text, Rule *rule){
+  *rule = (Rule){0};
+  if(strlen(text) >= MAX_TEXT){
+    return "rule text too long";
+  }
+  strcpy(rule->text, text);
+
+  Parser p = {
+    .pos = text,
+    .rule = rule,
+  };
+  next(&p);
+  if(!accept(&p, "if")){
+    return "rules start with if";
+  }
+  or_expr(&p);
+  if(!accept(&p, "then")){
+    fail(&p, "expected then");
+  }
+
+  int target = 0;
+  while(target < RULE_NUM_TARGETS && strcmp(p.tok, target_names[target]) != 0){
+    target++;
+  }
+  if(target == RULE_NUM_TARGETS){
+    fail(&p, "expected fan, vent or lamp");
+  }
+  rule->target = target;
+  next(&p);
+
+  long pct = strtol(p.tok, NULL, 10); // the token is all digits, so only its size needs checking
+  if(!isdigit((unsigned char)p.tok[0]) || pct > 100){
+    fail(&p, "expected a percentage from 0 to 100");
+    pct = 0;
+  }
+  rule->pct = pct;
+  next(&p);
+  accept(&p, "%");
+  if(p.tok[0] != '\0'){
+    fail(&p, "unexpected text after the rule");
+  }
+  return p.error;
+}
+
+/**************************************
+ * Stack machine
+ * Code has no jumps and was checked by the compiler, so it runs in len steps without bounds checks.
+ */
+
+static bool run(const Rule *rule, const int32_t inputs[]){
+  int32_t stack[MAX_STACK];
+  int sp = 0;
+  int pc = 0;
+  while(pc < rule->len){
+    uint8_t op = rule->code[pc++];
+    switch(op){
+      case(OP_CONST):
+        stack[sp++] = (int16_t)(rule->code[pc] | (rule->code[pc + 1] << 8));
+        pc += 2;
+        continue;
+      case(OP_INPUT):
+        stack[sp++] = inputs[rule->code[pc++]];
+        continue;
+      case(OP_NOT):
+        stack[sp - 1] = !stack[sp - 1];
+        continue;
+      default:
+        break;
+    }
+    int32_t b = stack[--sp];
+    int32_t a = stack[sp - 1];
+    switch(op){
+      case(OP_ADD): a = a + b; break;
+      case(OP_SUB): a = a - b; break;
+      case(OP_GT): a = a > b; break;
+      case(OP_LT): a = a < b; break;
+      case(OP_GE): a = a >= b; break;
+      case(OP_LE): a = a <= b; break;
+      case(OP_EQ): a = a == b; break;
+      case(OP_NE): a = a != b; break;
+      case(OP_AND): a = a && b; break;
+      case(OP_OR): a = a || b; break;
+      default: break;
+    }
+    stack[sp - 1] = a;
+  }
+  return stack[0] != 0;
+}
+
+int rules_evaluate(const RuleSnapshot *snapshot, RuleAction actions[], int max_actions){
+  int64_t start = esp_timer_get_time();
+  int num_actions = 0;
+  taskENTER_CRITICAL(&rules_lock);
+  for(int i = 0; i < num_rules; i++){
+    Rule *rule = &rules[i];
+    bool is_true = (rule->inputs & ~snapshot->known) == 0 && run(rule, snapshot->values);
+    if(is_true && !rule->was_true){
+      if(num_actions == max_actions){
+        continue; // fires on the next cycle instead
+      }
+      actions[num_actions++] = (RuleAction){
+        .target = rule->target,
+        .pct = rule->pct,
+      };
+    }
+    rule->was_true = is_true;
+  }
+  taskEXIT_CRITICAL(&rules_lock);
+  metric_add(METRIC_RULES_FIRED, num_actions);
+  metric_observe(METRIC_RULES_EVAL_US, (uint32_t)(esp_timer_get_time() - start));
+  return num_actions;
+}
+
+/**************************************
+ * Storage and console
+ */
+
+static bool add_rule(const Rule *rule){
+  bool added = false;
+  taskENTER_CRITICAL(&rules_lock);
+  if(num_rules < MAX_RULES){
+    rules[num_rules++] = *rule;
+    added = true;
+  }
+  taskEXIT_CRITICAL(&rules_lock);
+  return added;
+}
+
+//rules are saved as their source, one per line, and compiled again on load
+//only the console changes rules, so the table is read here without the lock
+static void save_rules(){
+  save_buf[0] = '\0';
+  for(int i = 0; i < num_rules; i++){
+    strcat(save_buf, rules[i].text);
+    strcat(save_buf, "\n");
+  }
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if(err == ESP_OK){
+    err = nvs_set_str(handle, NVS_KEY, save_buf);
+    if(err == ESP_OK){
+      err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+  }
+  if(err != ESP_OK){
+    ESP_LOGE(TAG, "Error (%d): Could not save rules", err);
+  }
+}
+
+void rules_load(){
+  char buf[MAX_RULES * MAX_TEXT + 1];
+  size_t len = sizeof(buf);
+  nvs_handle_t handle;
+  if(nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK){
+    return; // nothing saved yet
+  }
+  esp_err_t err = nvs_get_str(handle, NVS_KEY, buf, &len);
+  nvs_close(handle);
+  if(err != ESP_OK){
+    return;
+  }
+
+  char *save;
+  for(char *line = strtok_r(buf, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)){
+    Rule rule;
+    const char *error = compile(line, &rule);
+    if(error != NULL){
+      ESP_LOGE(TAG, "Saved rule \"%s\": %s", line, error);
+    }else if(!add_rule(&rule)){
+      ESP_LOGE(TAG, "Rule table full, skipped \"%s\"", line);
+    }
+  }
+  ESP_LOGI(TAG, "Loaded %d rules", num_rules);
+}
+
+static void rule_cmd(const char *args){
+  if(strncmp(args, "add ", 4) == 0){
+    Rule rule;
+    const char *error = compile(args + 4, &rule);
+    if(error != NULL){
+      printf("Rule error: %s\n", error);
+    }else if(!add_rule(&rule)){
+      printf("Rule table is full (%d rules)\n", MAX_RULES);
+    }else{
+      save_rules();
+      printf("Rule %d: %d bytes of code\n", num_rules - 1, rule.len);
+    }
+  }else if(strncmp(args, "del ", 4) == 0){
+    char *end;
+    long idx = strtol(args + 4, &end, 10);
+    if(end == args + 4 || *end != '\0' || idx < 0 || idx >= num_rules){
+      printf("No rule %s\n", args + 4);
+      return;
+    }
+    taskENTER_CRITICAL(&rules_lock);
+    memmove(&rules[idx], &rules[idx + 1], (num_rules - idx - 1) * sizeof(Rule));
+    num_rules--;
+    taskEXIT_CRITICAL(&rules_lock);
+    save_rules();
+  }else if(strcmp(args, "clear") == 0){
+    taskENTER_CRITICAL(&rules_lock);
+    num_rules = 0;
+    taskEXIT_CRITICAL(&rules_lock);
+    save_rules();
+  }else{
+    for(int i = 0; i < num_rules; i++){
+      printf("%d: %s (%d bytes)\n", i, rules[i].text, rules[i].len);
+    }
+    printf("%d of %d rules\n", num_rules, MAX_RULES);
+  }
+}
+
+void rules_init(){
+  serial_cmd_register("rule", "list rules, 'rule add if <cond> then <fan|vent|lamp> <pct>', 'rule del <n>', 'rule clear'", rule_cmd);
+}
@@ -0,0 +1,43 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+/**************************************
+ * Time of day schedule
+ * Events are written as "<days> <time> <actuator> <percent>", for example
+ *   weekdays 18:00 lamp 40
+ *   daily sunset-30 vent 0
+ * Days are daily, weekdays, weekends or a list like mon,wed,fri. Times are HH:MM in
+ * local time, or sunrise / sunset with an optional offset in minutes.
+ */
+
+//X(id, name)
+#define SCHEDULE_TARGETS(X) \
+  X(SCHEDULE_FAN,  "fan") \
+  X(SCHEDULE_VENT, "vent") \
+  X(SCHEDULE_LAMP, "lamp")
+
+#define SCHEDULE_ID(id, name) id,
+typedef enum { SCHEDULE_TARGETS(SCHEDULE_ID) SCHEDULE_NUM_TARGETS } ScheduleTarget;
+#undef SCHEDULE_ID
+
+//called from the esp_timer task when an event is due, must not block
+typedef void (*ScheduleHandler)(ScheduleTarget target, uint8_t pct);
+
+#if CONFIG_DESK_NETWORK
+//lock must be created by the caller (see the RTOS manifest in main)
+void schedule_init(SemaphoreHandle_t lock, ScheduleHandler handler);
+void schedule_load(); // read the events saved in nvs, nvs must already be initialized
+void schedule_recompute(); // call whenever the wall clock is set or stepped
+#else
+//offline builds never learn the time of day, so nothing is ever due
+static inline void schedule_init(SemaphoreHandle_t lock, ScheduleHandler handler){}
+static inline void schedule_load(){}
+static inline void schedule_recompute(){}
+#endif
+
+#endif
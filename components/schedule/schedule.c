@@ -0,0 +1,457 @@
+#include "schedule.h"
+#include "serial_cmd.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_EVENTS CONFIG_SCHEDULE_MAX_EVENTS
+#define MAX_TEXT 40 // source of one event, kept for listing and saving
+#define NVS_NAMESPACE "schedule"
+#define NVS_KEY "src"
+#define CLOCK_VALID_YEAR 121 // tm_year before 2021 means sntp has not set the clock yet
+
+#define DEG_TO_RAD 0.017453293f
+
+typedef enum {
+  AT_CLOCK = 0, // minutes is the minute of the day
+  AT_SUNRISE = 1, // minutes is an offset from sunrise
+  AT_SUNSET = 2, // minutes is an offset from sunset
+} ScheduleAnchor;
+
+typedef struct {
+  uint8_t days; // bit per weekday, bit 0 is sunday
+  ScheduleAnchor anchor;
+  int16_t minutes;
+  ScheduleTarget target;
+  uint8_t pct;
+  time_t next; // next occurrence, 0 until the clock is valid
+  char text[MAX_TEXT];
+} ScheduleEvent;
+
+#define SCHEDULE_NAME(id, name) name,
+static const char *target_names[SCHEDULE_NUM_TARGETS] = {SCHEDULE_TARGETS(SCHEDULE_NAME)};
+#undef SCHEDULE_NAME
+static const char *day_names[7] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+//kept sorted by next occurrence, events with no next occurrence last
+static ScheduleEvent events[MAX_EVENTS];
+static int num_events = 0;
+static SemaphoreHandle_t events_lock;
+static esp_timer_handle_t next_timer;
+static ScheduleHandler fire_handler;
+static char save_buf[MAX_EVENTS * MAX_TEXT + 1];
+
+static const char *TAG = "Schedule";
+
+/**************************************
+ * Time
+ */
+
+//days since 1970-01-01 for a calendar date, valid for any year after 1970
+static int32_t days_from_civil(int year, int month, int day){
+  year -= month <= 2;
+  int32_t era = year / 400;
+  int32_t yoe = year - era * 400;
+  int32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+//minutes after utc midnight of the sunrise or sunset on a day of the year, which can fall outside 0-1440
+//uses the noaa approximation, good to a couple of minutes, returns false when the sun does not rise or set
+static bool sun_minutes_utc(int yday, bool sunset, int *minutes){
+  float lat = CONFIG_SCHEDULE_LATITUDE / 100.0f * DEG_TO_RAD;
+  float lng = CONFIG_SCHEDULE_LONGITUDE / 100.0f;
+  float gamma = 2.0f * (float)M_PI / 365.0f * yday;
+  float eqtime = 229.18f * (0.000075f + 0.001868f * cosf(gamma) - 0.032077f * sinf(gamma)
+                 - 0.014615f * cosf(2 * gamma) - 0.040849f * sinf(2 * gamma));
+  float decl = 0.006918f - 0.399912f * cosf(gamma) + 0.070257f * sinf(gamma)
+               - 0.006758f * cosf(2 * gamma) + 0.000907f * sinf(2 * gamma)
+               - 0.002697f * cosf(3 * gamma) + 0.00148f * sinf(3 * gamma);
+  float cos_ha = cosf(90.833f * DEG_TO_RAD) / (cosf(lat) * cosf(decl)) - tanf(lat) * tanf(decl);
+  if(cos_ha < -1.0f || cos_ha > 1.0f){
+    return false;
+  }
+  float ha = acosf(cos_ha) / DEG_TO_RAD;
+  *minutes = (int)lroundf(720.0f - 4.0f * (lng + (sunset ? -ha : ha)) - eqtime);
+  return true;
+}
+
+//when the event happens on the local date in day, or 0 if it does not happen that day
+//clock times go through mktime for that date, so the answer is right whichever side of a dst change it is on
+static time_t occurrence_on(const ScheduleEvent *event, const struct tm *day){
+  if(event->anchor == AT_CLOCK){
+    struct tm at = {
+      .tm_year = day->tm_year,
+      .tm_mon = day->tm_mon,
+      .tm_mday = day->tm_mday,
+      .tm_hour = event->minutes / 60,
+      .tm_min = event->minutes % 60,
+      .tm_isdst = -1,
+    };
+    return mktime(&at);
+  }
+  int sun;
+  if(!sun_minutes_utc(day->tm_yday, event->anchor == AT_SUNSET, &sun)){
+    return 0;
+  }
+  int32_t days = days_from_civil(day->tm_year + 1900, day->tm_mon + 1, day->tm_mday);
+  return (time_t)days * 86400 + (sun + event->minutes) * 60;
+}
+
+static time_t next_occurrence(const ScheduleEvent *event, time_t after){
+  struct tm today;
+  localtime_r(&after, &today);
+  if(today.tm_year < CLOCK_VALID_YEAR){
+    return 0;
+  }
+  //a week and a day covers every weekday plus today's time having passed
+  for(int i = 0; i <= 7; i++){
+    struct tm day = today;
+    day.tm_mday += i;
+    day.tm_hour = 12; // midday keeps mktime away from dst gaps while it normalizes the date
+    day.tm_isdst = -1;
+    mktime(&day);
+    if(event->days & (1 << day.tm_wday)){
+      time_t at = occurrence_on(event, &day);
+      if(at > after){
+        return at;
+      }
+    }
+  }
+  return 0;
+}
+
+/**************************************
+ * Event list and timer
+ * Callers hold events_lock. The timer callback and the sntp callback wait on it, so it is
+ * only ever held for work on the list itself, never across nvs writes or console output.
+ */
+
+//events with no next occurrence sort last
+static time_t sort_key(const ScheduleEvent *event){
+  return event->next == 0 ? (time_t)INT32_MAX : event->next;
+}
+
+static void sort_events(){
+  for(int i = 1; i < num_events; i++){
+    ScheduleEvent event = events[i];
+    int j = i;
+    while(j > 0 && sort_key(&events[j - 1]) > sort_key(&event)){
+      events[j] = events[j - 1];
+      j--;
+    }
+    events[j] = event;
+  }
+}
+
+//the only timer the schedule uses, armed for whichever event is first
+static void arm_next(){
+  esp_timer_stop(next_timer); // fails harmlessly when the timer is not running
+  if(num_events == 0 || events[0].next == 0){
+    return;
+  }
+  int64_t delay_s = events[0].next - time(NULL);
+  if(delay_s < 0){
+    delay_s = 0;
+  }
+  ESP_ERROR_CHECK(esp_timer_start_once(next_timer, delay_s * 1000000));
+}
+
+static void recompute_locked(){
+  time_t now = time(NULL);
+  for(int i = 0; i < num_events; i++){
+    events[i].next = next_occurrence(&events[i], now);
+  }
+  sort_events();
+  arm_next();
+}
+
+static void next_timer_cb(void *arg){
+  struct {
+    ScheduleTarget target;
+    uint8_t pct;
+  } due[MAX_EVENTS];
+  int num_due = 0;
+
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  time_t now = time(NULL);
+  for(int i = 0; i < num_events && events[i].next != 0 && events[i].next <= now; i++){
+    due[num_due].target = events[i].target;
+    due[num_due].pct = events[i].pct;
+    num_due++;
+    events[i].next = next_occurrence(&events[i], now);
+  }
+  sort_events();
+  arm_next();
+  xSemaphoreGive(events_lock);
+
+  for(int i = 0; i < num_due; i++){
+    fire_handler(due[i].target, due[i].pct);
+  }
+}
+
+void schedule_recompute(){
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  recompute_locked();
+  xSemaphoreGive(events_lock);
+}
+
+/**************************************
+ * Parsing, storage and console
+ */
+
+static bool parse_days(const char *word, uint8_t *days){
+  if(strcmp(word, "daily") == 0){
+    *days = 0x7f;
+    return true;
+  }
+  if(strcmp(word, "weekdays") == 0){
+    *days = 0x3e;
+    return true;
+  }
+  if(strcmp(word, "weekends") == 0){
+    *days = 0x41;
+    return true;
+  }
+  *days = 0;
+  const char *pos = word;
+  while(*pos != '\0'){
+    int day = 0;
+    while(day < 7 && strncmp(pos, day_names[day], 3) != 0){
+      day++;
+    }
+    if(day == 7){
+      return false;
+    }
+    *days |= 1 << day;
+    pos += 3;
+    if(*pos == ','){
+      pos++;
+    }else if(*pos != '\0'){
+      return false;
+    }
+  }
+  return *days != 0;
+}
+
+static bool parse_time(const char *word, ScheduleEvent *event){
+  const char *offset = NULL;
+  if(strncmp(word, "sunrise", 7) == 0){
+    event->anchor = AT_SUNRISE;
+    offset = word + 7;
+  }else if(strncmp(word, "sunset", 6) == 0){
+    event->anchor = AT_SUNSET;
+    offset = word + 6;
+  }
+  if(offset != NULL){
+    if(*offset == '\0'){
+      event->minutes = 0;
+      return true;
+    }
+    char *end;
+    long minutes = strtol(offset, &end, 10);
+    event->minutes = minutes;
+    return (*offset == '+' || *offset == '-') && *end == '\0' && labs(minutes) <= 720;
+  }
+  int hour;
+  int minute;
+  char extra;
+  if(sscanf(word, "%d:%d%c", &hour, &minute, &extra) != 2 || hour < 0 || hour > 23 || minute < 0 || minute > 59){
+    return false;
+  }
+  event->anchor = AT_CLOCK;
+  event->minutes = hour * 60 + minute;
+  return true;
+}
+
+//parse "<days> <time> <actuator> <percent>", returns NULL or what was wrong
+static const char *parse_event(const char *text, ScheduleEvent *event){
+  *event = (ScheduleEvent){0};
+  if(strlen(text) >= MAX_TEXT){
+    return "event text too long";
+  }
+  strcpy(event->text, text);
+
+  char days[24];
+  char at[12];
+  char target[8];
+  int pct;
+  char extra;
+  if(sscanf(text, "%23s %11s %7s %d%c", days, at, target, &pct, &extra) != 4){
+    return "expected <days> <time> <actuator> <percent>";
+  }
+  if(!parse_days(days, &event->days)){
+    return "days are daily, weekdays, weekends or a list like mon,wed";
+  }
+  if(!parse_time(at, event)){
+    return "time is HH:MM, sunrise or sunset with an optional +/- minute offset";
+  }
+  int idx = 0;
+  while(idx < SCHEDULE_NUM_TARGETS && strcmp(target, target_names[idx]) != 0){
+    idx++;
+  }
+  if(idx == SCHEDULE_NUM_TARGETS){
+    return "expected fan, vent or lamp";
+  }
+  event->target = idx;
+  if(pct < 0 || pct > 100){
+    return "expected a percentage from 0 to 100";
+  }
+  event->pct = pct;
+  return NULL;
+}
+
+static bool add_event(const ScheduleEvent *event){
+  bool added = false;
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  if(num_events < MAX_EVENTS){
+    events[num_events++] = *event;
+    recompute_locked();
+    added = true;
+  }
+  xSemaphoreGive(events_lock);
+  return added;
+}
+
+//saved as source, one event per line, and parsed again on load
+//callers hold events_lock, the buffer is written out by save_events once it is released
+static void format_events(){
+  save_buf[0] = '\0';
+  for(int i = 0; i < num_events; i++){
+    strcat(save_buf, events[i].text);
+    strcat(save_buf, "\n");
+  }
+}
+
+//only the console task saves, so save_buf is not touched again until this returns
+static void save_events(){
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if(err == ESP_OK){
+    err = nvs_set_str(handle, NVS_KEY, save_buf);
+    if(err == ESP_OK){
+      err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+  }
+  if(err != ESP_OK){
+    ESP_LOGE(TAG, "Error (%d): Could not save schedule", err);
+  }
+}
+
+void schedule_load(){
+  char buf[MAX_EVENTS * MAX_TEXT + 1];
+  size_t len = sizeof(buf);
+  nvs_handle_t handle;
+  if(nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK){
+    return; // nothing saved yet
+  }
+  esp_err_t err = nvs_get_str(handle, NVS_KEY, buf, &len);
+  nvs_close(handle);
+  if(err != ESP_OK){
+    return;
+  }
+
+  char *save;
+  for(char *line = strtok_r(buf, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)){
+    ScheduleEvent event;
+    const char *error = parse_event(line, &event);
+    if(error != NULL){
+      ESP_LOGE(TAG, "Saved event \"%s\": %s", line, error);
+    }else if(!add_event(&event)){
+      ESP_LOGE(TAG, "Schedule full, skipped \"%s\"", line);
+    }
+  }
+  ESP_LOGI(TAG, "Loaded %d events", num_events);
+}
+
+static void sched_cmd(const char *args){
+  if(strncmp(args, "add ", 4) == 0){
+    ScheduleEvent event;
+    const char *error = parse_event(args + 4, &event);
+    if(error != NULL){
+      printf("Schedule error: %s\n", error);
+    }else if(!add_event(&event)){
+      printf("Schedule is full (%d events)\n", MAX_EVENTS);
+    }else{
+      xSemaphoreTake(events_lock, portMAX_DELAY);
+      format_events();
+      xSemaphoreGive(events_lock);
+      save_events();
+    }
+    return;
+  }
+
+  if(strncmp(args, "del ", 4) == 0){
+    char *end;
+    long idx = strtol(args + 4, &end, 10);
+    bool whole = end != args + 4 && *end == '\0'; // "x" or "1x" must not delete event 0 or 1
+    bool deleted = false;
+    xSemaphoreTake(events_lock, portMAX_DELAY);
+    if(whole && idx >= 0 && idx < num_events){
+      memmove(&events[idx], &events[idx + 1], (num_events - idx - 1) * sizeof(ScheduleEvent));
+      num_events--;
+      arm_next();
+      format_events();
+      deleted = true;
+    }
+    xSemaphoreGive(events_lock);
+    if(deleted){
+      save_events();
+    }else{
+      printf("No event %s\n", args + 4);
+    }
+  }else if(strcmp(args, "clear") == 0){
+    xSemaphoreTake(events_lock, portMAX_DELAY);
+    num_events = 0;
+    arm_next();
+    format_events();
+    xSemaphoreGive(events_lock);
+    save_events();
+  }else{
+    //listed in firing order, which is also the numbering del uses
+    //each event is copied out so the lock is not held while the uart drains
+    int listed = 0;
+    for(int i = 0; ; i++){
+      ScheduleEvent event;
+      xSemaphoreTake(events_lock, portMAX_DELAY);
+      listed = num_events;
+      bool more = i < num_events;
+      if(more){
+        event = events[i];
+      }
+      xSemaphoreGive(events_lock);
+      if(!more){
+        break;
+      }
+      char when[20] = "clock not set";
+      if(event.next != 0){
+        struct tm tm_local;
+        localtime_r(&event.next, &tm_local);
+        strftime(when, sizeof(when), "%a %H:%M", &tm_local);
+      }
+      printf("%d: %s (next %s)\n", i, event.text, when);
+    }
+    printf("%d of %d events\n", listed, MAX_EVENTS);
+  }
+}
+
+void schedule_init(SemaphoreHandle_t lock, ScheduleHandler handler){
+  events_lock = lock;
+  fire_handler = handler;
+  const esp_timer_create_args_t timer_args = {
+    .callback = next_timer_cb,
+    .name = "schedule",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &next_timer));
+  serial_cmd_register("sched", "list events, 'sched add <days> <HH:MM|sunset[+-min]> <fan|vent|lamp> <pct>', 'sched del <n>', 'sched clear'", sched_cmd);
+}
@@ -0,0 +1,12 @@
+#ifndef SERIAL_CMD_H
+#define SERIAL_CMD_H
+
+//handler for a console command, args points at the rest of the line after the command name
+typedef void (*SerialCmdHandler)(const char *args);
+
+void serial_cmd_register(const char *name, const char *help, SerialCmdHandler handler);
+
+//reads lines from the console uart and dispatches them to registered handlers
+void serial_cmd_task(void *parameters);
+
+#endif
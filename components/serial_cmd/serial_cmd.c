@@ -0,0 +1,89 @@
+#include "serial_cmd.h"
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <stdio.h>
+
+#define MAX_CMDS 16
+#define LINE_LEN 128
+#define UART_RX_BUF 256
+
+typedef struct {
+  const char *name;
+  const char *help;
+  SerialCmdHandler handler;
+} SerialCmd;
+
+static SerialCmd cmds[MAX_CMDS];
+static int num_cmds = 0;
+static portMUX_TYPE cmd_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "Serial Cmd";
+
+void serial_cmd_register(const char *name, const char *help, SerialCmdHandler handler){
+  taskENTER_CRITICAL(&cmd_lock);
+  if(num_cmds < MAX_CMDS){
+    cmds[num_cmds++] = (SerialCmd){
+      .name = name,
+      .help = help,
+      .handler = handler,
+    };
+  }
+  taskEXIT_CRITICAL(&cmd_lock);
+}
+
+static void print_help(){
+  printf("Commands:\n");
+  for(int i = 0; i < num_cmds; i++){
+    printf("  %-10s %s\n", cmds[i].name, cmds[i].help);
+  }
+}
+
+static void dispatch(char *line){
+  //split the command name from its arguments
+  char *args = line;
+  while(*args != '\0' && *args != ' '){
+    args++;
+  }
+  if(*args == ' '){
+    *args++ = '\0';
+  }
+  if(line[0] == '\0'){
+    return;
+  }
+
+  for(int i = 0; i < num_cmds; i++){
+    if(strcmp(line, cmds[i].name) == 0){
+      cmds[i].handler(args);
+      return;
+    }
+  }
+  print_help();
+}
+
+void serial_cmd_task(void *parameters){
+  char line[LINE_LEN];
+  int len = 0;
+  uint8_t c;
+
+  //the console uart is already configured by the bootloader, only the rx driver is needed
+  ESP_ERROR_CHECK(uart_driver_install(CONFIG_ESP_CONSOLE_UART_NUM, UART_RX_BUF, 0, 0, NULL, 0));
+  ESP_LOGI(TAG, "Listening for commands, type help for a list");
+
+  while(1){
+    if(uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, &c, 1, portMAX_DELAY) != 1){
+      continue;
+    }
+    if(c == '\r' || c == '\n'){
+      line[len] = '\0';
+      dispatch(line);
+      len = 0;
+    }else if(len < LINE_LEN - 1){
+      line[len++] = (char)c;
+    }
+  }
+}
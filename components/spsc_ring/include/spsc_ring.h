@@ -0,0 +1,62 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************************************
+ * Single producer, single consumer ring
+ * A fixed size ring for handing timestamped events from an ISR to one task without
+ * locks. The producer only writes head and the consumer only writes tail, each
+ * publishing its side with a release store, so exactly one context may push and one
+ * may pop. Pushing to a full ring drops the new event and counts it in overflow.
+ *
+ * SPSC_RING_DECLARE(ButtonRing, button_ring, ButtonEvent, 8) declares
+ *   ButtonRing       the ring, zero initialized rings are empty
+ *   ButtonRingEntry  an event and the time it was pushed
+ *   button_ring_push(ring, value, time_us), button_ring_pop(ring, entry)
+ * The functions are always inlined, so they run from IRAM when called from an IRAM
+ * ISR, as long as the ring itself is in internal RAM (any static variable is).
+ */
+
+#define SPSC_RING_DECLARE(type_name, prefix, item_type, capacity) \
+  _Static_assert((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0, #type_name " capacity must be a power of two"); \
+  typedef struct { \
+    int64_t time_us; \
+    item_type value; \
+  } type_name##Entry; \
+  typedef struct { \
+    uint32_t head; /* next slot to write, only the producer stores it */ \
+    uint32_t tail; /* next slot to read, only the consumer stores it */ \
+    uint32_t overflow; /* events dropped because the ring was full, only the producer stores it */ \
+    type_name##Entry slots[capacity]; \
+  } type_name; \
+  \
+  static inline __attribute__((always_inline)) bool prefix##_push(type_name *ring, item_type value, int64_t time_us){ \
+    uint32_t head = ring->head; \
+    if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == (capacity)){ \
+      __atomic_store_n(&ring->overflow, ring->overflow + 1, __ATOMIC_RELAXED); \
+      return false; \
+    } \
+    type_name##Entry *slot = &ring->slots[head & ((capacity) - 1)]; \
+    slot->time_us = time_us; \
+    slot->value = value; \
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE); \
+    return true; \
+  } \
+  \
+  static inline __attribute__((always_inline)) bool prefix##_pop(type_name *ring, type_name##Entry *entry){ \
+    uint32_t tail = ring->tail; \
+    if(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail){ \
+      return false; \
+    } \
+    *entry = ring->slots[tail & ((capacity) - 1)]; \
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE); \
+    return true; \
+  } \
+  \
+  static inline __attribute__((always_inline)) uint32_t prefix##_overflow(type_name *ring){ \
+    return __atomic_load_n(&ring->overflow, __ATOMIC_RELAXED); \
+  }
+
+#endif
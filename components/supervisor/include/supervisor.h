@@ -0,0 +1,37 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdint.h>
+
+/**************************************
+ * Health supervisor
+ * Every supervised part declares how often it beats and how long one job may take. A job
+ * runs from supervisor_begin to supervisor_end, time spent waiting for work in between is
+ * not counted. The task watchdog is only fed while every critical part is healthy, so a
+ * stuck critical part resets the chip. Parts with a restart hook are restarted first, on
+ * supervisor_restart_task, and only fall back to a reset when that does not bring them back.
+ */
+
+typedef enum {
+  SUPERVISE_REPORT = 0, // misses are counted and logged
+  SUPERVISE_RESTART = 1, // call the restart hook, reset after CONFIG_SUPERVISOR_MAX_RESTARTS failed restarts
+  SUPERVISE_CRITICAL = 2, // reset through the task watchdog unless it recovers first
+} SuperviseAction;
+
+typedef struct {
+  const char *name;
+  uint32_t heartbeat_ms; // longest gap allowed between beats, 0 for parts that may wait for work indefinitely
+  uint32_t max_latency_ms; // longest a single job may run
+  SuperviseAction action;
+  void (*restart)(void); // SUPERVISE_RESTART only, called from supervisor_restart_task
+} SupervisedDef;
+
+void supervisor_init(const SupervisedDef *defs, int count); // registers the "health" console command
+void supervisor_beat(int id);
+void supervisor_begin(int id); // a job started, this is also a beat
+void supervisor_end(int id); // the job is done and its latency recorded, does nothing when no job was running
+void supervisor_task(void *parameters);
+//runs restart hooks for the supervisor task, size its stack for the deepest hook
+void supervisor_restart_task(void *parameters);
+
+#endif
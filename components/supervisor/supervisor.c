@@ -0,0 +1,225 @@
+#include "supervisor.h"
+#include "serial_cmd.h"
+#include "metrics.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#define MAX_PARTS 16
+#define GRACE_US ((int64_t)CONFIG_SUPERVISOR_RESTART_GRACE_S * 1000000)
+_Static_assert(MAX_PARTS <= 32, "restart requests take a notification bit per part");
+
+typedef struct {
+  int64_t last_beat_us;
+  int64_t begin_us; // 0 while waiting for work
+  uint32_t jobs;
+  uint32_t misses; // late heartbeats and jobs past their deadline
+  bool late; // the current heartbeat gap has been counted as a miss
+  bool overrun; // the running job has been counted as a miss
+  bool healthy;
+  //recovery, only the supervisor task touches these
+  uint32_t restarts;
+  int attempts; // restarts since the part was last healthy
+  int64_t restart_us;
+  MetricHistogramData latency;
+} PartState;
+
+static const SupervisedDef *defs;
+static int num_parts = 0;
+static PartState parts[MAX_PARTS];
+static portMUX_TYPE part_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t restart_task = NULL; // runs the restart hooks, one notification bit per part
+
+static const char *action_names[] = {"report", "restart", "critical"};
+
+static const char *TAG = "Supervisor";
+
+void supervisor_beat(int id){
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&part_lock);
+  parts[id].last_beat_us = now;
+  parts[id].late = false;
+  portEXIT_CRITICAL(&part_lock);
+}
+
+void supervisor_begin(int id){
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&part_lock);
+  parts[id].begin_us = now;
+  parts[id].last_beat_us = now;
+  parts[id].late = false;
+  portEXIT_CRITICAL(&part_lock);
+}
+
+void supervisor_end(int id){
+  PartState *part = &parts[id];
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&part_lock);
+  if(part->begin_us == 0){
+    portEXIT_CRITICAL(&part_lock);
+    return;
+  }
+  uint32_t latency_us = now - part->begin_us;
+  //a job the supervisor already caught running late is not counted twice
+  bool missed = !part->overrun && latency_us > defs[id].max_latency_ms * 1000;
+  if(missed){
+    part->misses++;
+  }
+  part->begin_us = 0;
+  part->overrun = false;
+  part->last_beat_us = now;
+  part->late = false;
+  part->jobs++;
+  portEXIT_CRITICAL(&part_lock);
+
+  metric_record(&part->latency, latency_us);
+  if(missed){
+    metric_inc(METRIC_DEADLINE_MISSED);
+  }
+}
+
+//a part is healthy while its running job is within its deadline and its last beat is recent enough
+static bool check(int id, int64_t now){
+  const SupervisedDef *def = &defs[id];
+  PartState *part = &parts[id];
+  bool stuck = false;
+  bool late = false;
+  bool missed = false;
+  portENTER_CRITICAL(&part_lock);
+  if(part->begin_us != 0 && now - part->begin_us > (int64_t)def->max_latency_ms * 1000){
+    stuck = true;
+    missed |= !part->overrun;
+    part->overrun = true;
+  }
+  if(def->heartbeat_ms > 0 && now - part->last_beat_us > (int64_t)def->heartbeat_ms * 1000){
+    late = true;
+    missed |= !part->late;
+    part->late = true;
+  }
+  if(missed){
+    part->misses++;
+  }
+  part->healthy = !stuck && !late;
+  portEXIT_CRITICAL(&part_lock);
+
+  if(missed){
+    metric_inc(METRIC_DEADLINE_MISSED);
+    ESP_LOGW(TAG, "%s %s", def->name, stuck ? "is past its job deadline" : "missed its heartbeat");
+  }
+  return !stuck && !late;
+}
+
+//returns false when the part needs the chip reset
+static bool recover(int id, bool healthy, int64_t now){
+  const SupervisedDef *def = &defs[id];
+  PartState *part = &parts[id];
+  if(healthy){
+    if(part->attempts > 0){
+      ESP_LOGI(TAG, "%s recovered after %d restarts", def->name, part->attempts);
+      part->attempts = 0;
+    }
+    return true;
+  }
+  switch(def->action){
+    case(SUPERVISE_RESTART):
+      if(part->attempts > 0 && now - part->restart_us < GRACE_US){
+        return true; // the last restart still has time to work
+      }
+      if(part->attempts >= CONFIG_SUPERVISOR_MAX_RESTARTS){
+        return false;
+      }
+      TaskHandle_t restarter = __atomic_load_n(&restart_task, __ATOMIC_ACQUIRE);
+      if(restarter == NULL){
+        return true; // nothing can run the hook yet, try again on the next check
+      }
+      part->attempts++;
+      part->restarts++;
+      part->restart_us = now;
+      metric_inc(METRIC_SUBSYSTEM_RESTARTS);
+      ESP_LOGW(TAG, "Restarting %s, attempt %d of %d", def->name, part->attempts, CONFIG_SUPERVISOR_MAX_RESTARTS);
+      //a hook can take seconds and a deep stack, so it runs on the restart task and this one
+      //goes on checking and feeding the watchdog
+      xTaskNotify(restarter, 1u << id, eSetBits);
+      return true;
+    case(SUPERVISE_CRITICAL):
+      return false;
+    default:
+      return true;
+  }
+}
+
+//the supervisor is the only task it adds to the task watchdog, a reset comes from starving it
+void supervisor_task(void *parameters){
+  ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+  TickType_t last_wake = xTaskGetTickCount();
+  bool feeding = true;
+  while(1){
+    int64_t now = esp_timer_get_time();
+    const char *failing = NULL;
+    for(int id = 0; id < num_parts; id++){
+      bool healthy = check(id, now);
+      if(!recover(id, healthy, now) && failing == NULL){
+        failing = defs[id].name;
+      }
+    }
+    if(failing == NULL){
+      esp_task_wdt_reset();
+    }else if(feeding){
+      ESP_LOGE(TAG, "%s is unhealthy, the task watchdog resets the chip unless it recovers", failing);
+    }
+    feeding = failing == NULL;
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_SUPERVISOR_CHECK_MS));
+  }
+}
+
+void supervisor_restart_task(void *parameters){
+  __atomic_store_n(&restart_task, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+  while(1){
+    uint32_t pending;
+    xTaskNotifyWait(0, UINT32_MAX, &pending, portMAX_DELAY);
+    for(int id = 0; id < num_parts; id++){
+      if(pending & (1u << id)){
+        defs[id].restart();
+      }
+    }
+  }
+}
+
+//latency percentiles are bucket upper bounds, so they read as "at most"
+static void health_cmd(const char *args){
+  printf("%-12s %-8s %8s %6s %4s %8s %8s %8s %8s %s\n", "part", "action", "jobs", "misses", "rst",
+         "p50_us", "p90_us", "p99_us", "max_us", "state");
+  for(int id = 0; id < num_parts; id++){
+    PartState *part = &parts[id];
+    portENTER_CRITICAL(&part_lock);
+    uint32_t jobs = part->jobs;
+    uint32_t misses = part->misses;
+    bool healthy = part->healthy;
+    portEXIT_CRITICAL(&part_lock);
+    printf("%-12s %-8s %8" PRIu32 " %6" PRIu32 " %4" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %s\n",
+           defs[id].name, action_names[defs[id].action], jobs, misses, part->restarts,
+           metric_percentile_us(&part->latency, 50), metric_percentile_us(&part->latency, 90),
+           metric_percentile_us(&part->latency, 99), __atomic_load_n(&part->latency.max_us, __ATOMIC_RELAXED),
+           healthy ? "ok" : "UNHEALTHY");
+  }
+}
+
+void supervisor_init(const SupervisedDef *supervised, int count){
+  configASSERT(count <= MAX_PARTS);
+  defs = supervised;
+  num_parts = count;
+  //heartbeats are measured from here, so a part that never starts is noticed too
+  int64_t now = esp_timer_get_time();
+  for(int id = 0; id < count; id++){
+    parts[id].last_beat_us = now;
+    parts[id].healthy = true;
+  }
+  serial_cmd_register("health", "deadline misses, restarts and job latency percentiles of every supervised part", health_cmd);
+}
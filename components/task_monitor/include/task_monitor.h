@@ -0,0 +1,23 @@
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#if CONFIG_DESK_DIAGNOSTICS
+//tell the monitor how large a task's stack is so it can recommend a size for it
+void task_monitor_register(TaskHandle_t task, uint32_t stack_bytes);
+
+void task_monitor_report(); // print cpu and stack figures for every task seen so far
+int task_monitor_core_busy_tenths(int core); // share of the core not spent idle, -1 until it has been sampled
+void task_monitor_task(void *parameters);
+#else
+//only the telemetry profile has the monitor, its task is left out of the manifest too
+static inline void task_monitor_register(TaskHandle_t task, uint32_t stack_bytes){}
+static inline void task_monitor_report(){}
+static inline int task_monitor_core_busy_tenths(int core){ return -1; }
+#endif
+
+#endif
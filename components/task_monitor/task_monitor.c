@@ -0,0 +1,204 @@
+#include "task_monitor.h"
+#include "serial_cmd.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#define MAX_TASKS 24
+#define STACK_ROUND 256 //recommended stacks are rounded up to this many bytes
+#define EMA_SHIFT 2 //weight of a new cpu sample is 1/4
+
+typedef struct {
+  TaskHandle_t handle;
+  char name[configMAX_TASK_NAME_LEN];
+  uint32_t stack_bytes; // 0 when the task was not registered
+  uint32_t min_free; // lowest free stack seen, in bytes
+  uint32_t last_runtime;
+  uint32_t cpu_tenths; // rolling cpu use in tenths of a percent of one core
+  int core;
+  int prio;
+  bool alive;
+  bool idle; // the idle task of its core, whatever it does not use the core spends working
+} TaskRecord;
+
+static TaskRecord records[MAX_TASKS];
+static int num_records = 0;
+static uint32_t last_total_runtime = 0;
+static portMUX_TYPE record_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "Task Monitor";
+
+//returns the record for a task, creating it if there is room
+static TaskRecord *find_record(TaskHandle_t task){
+  for(int i = 0; i < num_records; i++){
+    if(records[i].handle == task){
+      return &records[i];
+    }
+  }
+  if(num_records < MAX_TASKS){
+    TaskRecord *rec = &records[num_records++];
+    *rec = (TaskRecord){
+      .handle = task,
+      .min_free = UINT32_MAX,
+    };
+    return rec;
+  }
+  return NULL;
+}
+
+void task_monitor_register(TaskHandle_t task, uint32_t stack_bytes){
+  taskENTER_CRITICAL(&record_lock);
+  TaskRecord *rec = find_record(task);
+  if(rec != NULL){
+    rec->stack_bytes = stack_bytes;
+  }
+  taskEXIT_CRITICAL(&record_lock);
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+static TaskStatus_t status[MAX_TASKS];
+
+static void sample(){
+  configRUN_TIME_COUNTER_TYPE total_runtime = 0;
+  UBaseType_t count = uxTaskGetSystemState(status, MAX_TASKS, &total_runtime);
+  uint32_t elapsed = (uint32_t)total_runtime - last_total_runtime;
+
+  taskENTER_CRITICAL(&record_lock);
+  for(int i = 0; i < num_records; i++){
+    records[i].alive = false;
+  }
+  for(UBaseType_t i = 0; i < count; i++){
+    TaskRecord *rec = find_record(status[i].xHandle);
+    if(rec == NULL){
+      continue;
+    }
+    bool first_sample = (rec->name[0] == '\0');
+    strlcpy(rec->name, status[i].pcTaskName, sizeof(rec->name));
+    rec->alive = true;
+    rec->prio = status[i].uxCurrentPriority;
+    rec->core = (status[i].xCoreID == tskNO_AFFINITY) ? -1 : status[i].xCoreID;
+    rec->idle = status[i].uxBasePriority == tskIDLE_PRIORITY && strncmp(rec->name, "IDLE", 4) == 0;
+
+    //high water mark is reported in bytes on esp-idf
+    if(status[i].usStackHighWaterMark < rec->min_free){
+      rec->min_free = status[i].usStackHighWaterMark;
+    }
+
+    //run time counters wrap, unsigned subtraction keeps the delta correct
+    uint32_t ran = (uint32_t)status[i].ulRunTimeCounter - rec->last_runtime;
+    rec->last_runtime = (uint32_t)status[i].ulRunTimeCounter;
+    if(elapsed > 0 && last_total_runtime != 0){
+      uint32_t tenths = (uint32_t)(((uint64_t)ran * 1000) / elapsed);
+      if(first_sample){
+        rec->cpu_tenths = tenths;
+      }else{
+        rec->cpu_tenths += ((int32_t)tenths - (int32_t)rec->cpu_tenths) >> EMA_SHIFT;
+      }
+    }
+  }
+  taskEXIT_CRITICAL(&record_lock);
+  last_total_runtime = (uint32_t)total_runtime;
+}
+
+#else
+
+static void sample(){
+  //without run time stats only the stack high water marks of registered tasks are available
+  taskENTER_CRITICAL(&record_lock);
+  for(int i = 0; i < num_records; i++){
+    UBaseType_t free_bytes = uxTaskGetStackHighWaterMark(records[i].handle);
+    strlcpy(records[i].name, pcTaskGetName(records[i].handle), sizeof(records[i].name));
+    records[i].alive = true;
+    records[i].core = -1;
+    if(free_bytes < records[i].min_free){
+      records[i].min_free = free_bytes;
+    }
+  }
+  taskEXIT_CRITICAL(&record_lock);
+}
+
+#endif
+
+//deepest observed use plus the configured margin, rounded up
+static uint32_t recommend_stack(const TaskRecord *rec){
+  uint32_t used = rec->stack_bytes - rec->min_free;
+  uint32_t recommended = used + (used * CONFIG_TASK_MONITOR_STACK_MARGIN_PCT) / 100;
+  recommended = (recommended + STACK_ROUND - 1) / STACK_ROUND * STACK_ROUND;
+  if(recommended < configMINIMAL_STACK_SIZE){
+    recommended = configMINIMAL_STACK_SIZE;
+  }
+  return recommended;
+}
+
+void task_monitor_report(){
+  TaskRecord snapshot[MAX_TASKS];
+  taskENTER_CRITICAL(&record_lock);
+  int count = num_records;
+  memcpy(snapshot, records, sizeof(records));
+  taskEXIT_CRITICAL(&record_lock);
+
+  printf("%-16s %4s %4s %6s %8s %6s %9s\n", "Task", "Core", "Prio", "CPU%", "MinFree", "Stack", "Recommend");
+  for(int i = 0; i < count; i++){
+    const TaskRecord *rec = &snapshot[i];
+    if(!rec->alive){
+      continue;
+    }
+    printf("%-16s %4d %4d %4" PRIu32 ".%" PRIu32 " %8" PRIu32,
+           rec->name, rec->core, rec->prio,
+           rec->cpu_tenths / 10, rec->cpu_tenths % 10, rec->min_free);
+    if(rec->stack_bytes > 0){
+      printf(" %6" PRIu32 " %9" PRIu32 "\n", rec->stack_bytes, recommend_stack(rec));
+    }else{
+      printf(" %6s %9s\n", "-", "-");
+    }
+  }
+  for(int core = 0; core < portNUM_PROCESSORS; core++){
+    int busy = task_monitor_core_busy_tenths(core);
+    if(busy >= 0){
+      printf("Core %d busy %d.%d%%\n", core, busy / 10, busy % 10);
+    }
+  }
+}
+
+int task_monitor_core_busy_tenths(int core){
+  int busy = -1;
+  taskENTER_CRITICAL(&record_lock);
+  for(int i = 0; i < num_records; i++){
+    if(records[i].alive && records[i].idle && records[i].core == core){
+      busy = records[i].cpu_tenths >= 1000 ? 0 : 1000 - (int)records[i].cpu_tenths;
+    }
+  }
+  taskEXIT_CRITICAL(&record_lock);
+  return busy;
+}
+
+static void report_cmd(const char *args){
+  task_monitor_report();
+}
+
+void task_monitor_task(void *parameters){
+  TickType_t last_wake = xTaskGetTickCount();
+  uint32_t since_report_ms = 0;
+
+#if !(CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+  ESP_LOGW(TAG, "Run time stats disabled, only stack usage will be reported");
+#endif
+  serial_cmd_register("tasks", "cpu and stack use per task", report_cmd);
+
+  while(1){
+    sample();
+
+    since_report_ms += CONFIG_TASK_MONITOR_INTERVAL_MS;
+    if(CONFIG_TASK_MONITOR_REPORT_INTERVAL_S > 0 &&
+       since_report_ms >= CONFIG_TASK_MONITOR_REPORT_INTERVAL_S * 1000){
+      since_report_ms = 0;
+      task_monitor_report();
+    }
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_TASK_MONITOR_INTERVAL_MS));
+  }
+}
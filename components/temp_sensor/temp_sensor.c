@@ -4,13 +4,14 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "dlog.h"
 
 
 //max voltage that the temp sensor will output
 #define MAX_VLTG_MV 2000
 
 
-static char *TAG = "Temp Sensor";
+static DlogTag dlog_tag = DLOG_TAG_INIT("Temp Sensor", 5);
 adc_channel_t adc_channel_5;
 
 void temp_sensor_init(){
@@ -22,7 +23,7 @@ void temp_sensor_init(){
 
 int read_tmp_vltg(){
   int reading = read_vltg_from_channel(adc_channel_5);
-  ESP_LOGI(TAG, "Temp sensor reads value of %dmV", reading);
+  DLOGI(dlog_tag, "Temp sensor reads value of %dmV", reading);
   return reading;
 }
 
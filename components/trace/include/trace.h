@@ -0,0 +1,91 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+//X(id, chrome phase, name)
+//phase 'B'/'E' open and close a span on the core's track, 'i' is an instant event
+#define TRACE_EVENTS(X) \
+  X(TRACE_ISR_BUTTON,          'i', "isr.button") \
+  X(TRACE_ISR_POT_TIMER,       'i', "isr.pot_timer") \
+  X(TRACE_QUEUE_SEND,          'i', "queue.send") \
+  X(TRACE_QUEUE_SEND_FAIL,     'i', "queue.send_fail") \
+  X(TRACE_QUEUE_RECV,          'i', "queue.recv") \
+  X(TRACE_CONTROLLER_BEGIN,    'B', "controller.dispatch") \
+  X(TRACE_CONTROLLER_END,      'E', "controller.dispatch") \
+  X(TRACE_DISPLAY_FLUSH_BEGIN, 'B', "display.flush") \
+  X(TRACE_DISPLAY_FLUSH_END,   'E', "display.flush") \
+  X(TRACE_ACTUATOR_COMMIT,     'i', "actuator.commit")
+
+#define TRACE_EVENT_ID(id, phase, name) id,
+typedef enum {
+  TRACE_EVENTS(TRACE_EVENT_ID)
+  TRACE_NUM_EVENTS,
+} TraceEventId;
+#undef TRACE_EVENT_ID
+
+//actuator ids passed as the argument of TRACE_ACTUATOR_COMMIT
+typedef enum {
+  TRACE_FAN = 0,
+  TRACE_VENT = 1,
+  TRACE_LAMP = 2,
+  TRACE_LEVEL = 3,
+} TraceActuator;
+
+#if CONFIG_TRACE_ENABLE
+
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+
+_Static_assert((CONFIG_TRACE_BUFFER_EVENTS & (CONFIG_TRACE_BUFFER_EVENTS - 1)) == 0,
+               "CONFIG_TRACE_BUFFER_EVENTS must be a power of two");
+
+typedef struct {
+  uint32_t time_us; // low 32 bits of esp_timer_get_time, wraps after about 71 minutes
+  uint16_t event;
+  uint16_t arg;
+} TraceRecord;
+
+typedef struct {
+  uint32_t head; // total events ever recorded on this core
+  TraceRecord records[CONFIG_TRACE_BUFFER_EVENTS];
+} TraceRing;
+
+extern TraceRing trace_rings[portNUM_PROCESSORS];
+extern volatile bool trace_paused;
+
+//claiming the slot with an atomic add keeps the ring consistent when an ISR
+//interrupts a task mid-record, no lock is taken. The time is read first, so an ISR that
+//lands between the two can only leave its record a few microseconds out of order, which
+//the converter tolerates. esp_timer rather than the cycle counter, as the cpu clock
+//changes with dynamic frequency scaling
+static inline __attribute__((always_inline)) void trace_record(TraceEventId event, uint32_t arg){
+  if(trace_paused){
+    return;
+  }
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  TraceRing *ring = &trace_rings[esp_cpu_get_core_id()];
+  uint32_t idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) & (CONFIG_TRACE_BUFFER_EVENTS - 1);
+  ring->records[idx] = (TraceRecord){
+    .time_us = now,
+    .event = (uint16_t)event,
+    .arg = (uint16_t)arg,
+  };
+}
+
+#define TRACE(event, arg) trace_record((event), (arg))
+
+#else
+
+//arguments are not evaluated so disabled trace points cost nothing
+#define TRACE(event, arg) ((void)0)
+
+#endif
+
+void trace_init(); // registers the trace console command
+void trace_dump(); // prints every buffered event over the console uart
+void trace_clear();
+
+#endif
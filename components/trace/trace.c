@@ -0,0 +1,81 @@
+#include "trace.h"
+#include "serial_cmd.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#if CONFIG_TRACE_ENABLE
+
+TraceRing trace_rings[portNUM_PROCESSORS];
+volatile bool trace_paused = false;
+
+#define TRACE_EVENT_INFO(id, phase, name) {phase, name},
+static const struct {
+  char phase;
+  const char *name;
+} event_info[TRACE_NUM_EVENTS] = {
+  TRACE_EVENTS(TRACE_EVENT_INFO)
+};
+#undef TRACE_EVENT_INFO
+
+void trace_dump(){
+  //stop recording so the rings are stable while they are printed
+  trace_paused = true;
+
+  printf("TRACE BEGIN unit=us cores=%d\n", portNUM_PROCESSORS);
+  for(int i = 0; i < TRACE_NUM_EVENTS; i++){
+    printf("TRACE EVENT %d %c %s\n", i, event_info[i].phase, event_info[i].name);
+  }
+  for(int core = 0; core < portNUM_PROCESSORS; core++){
+    TraceRing *ring = &trace_rings[core];
+    uint32_t head = ring->head;
+    uint32_t start = (head > CONFIG_TRACE_BUFFER_EVENTS) ? head - CONFIG_TRACE_BUFFER_EVENTS : 0;
+    //oldest to newest
+    for(uint32_t i = start; i < head; i++){
+      const TraceRecord *rec = &ring->records[i & (CONFIG_TRACE_BUFFER_EVENTS - 1)];
+      printf("TRACE REC %d %" PRIu32 " %u %u\n", core, rec->time_us, rec->event, rec->arg);
+    }
+    if(start > 0){
+      printf("TRACE LOST %d %" PRIu32 "\n", core, start);
+    }
+  }
+  printf("TRACE END\n");
+
+  trace_paused = false;
+}
+
+void trace_clear(){
+  trace_paused = true;
+  for(int core = 0; core < portNUM_PROCESSORS; core++){
+    trace_rings[core].head = 0;
+  }
+  trace_paused = false;
+}
+
+#else
+
+static const char *TAG = "Trace";
+
+void trace_dump(){
+  ESP_LOGW(TAG, "Tracing is compiled out, enable CONFIG_TRACE_ENABLE");
+}
+
+void trace_clear(){
+}
+
+#endif
+
+static void trace_cmd(const char *args){
+  if(strcmp(args, "clear") == 0){
+    trace_clear();
+  }else{
+    trace_dump();
+  }
+}
+
+void trace_init(){
+  serial_cmd_register("trace", "dump trace buffer, 'trace clear' empties it", trace_cmd);
+}
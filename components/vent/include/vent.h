@@ -11,5 +11,7 @@ bool get_vent_is_enabled();
 void vent_toggle_enabled();
 void vent_toggle_auto();
 void vent_send_sensor_pct(uint8_t sensor_pct);
+void vent_close();
+void vent_resume();
 
 #endif
\ No newline at end of file
@@ -3,6 +3,14 @@
 #include "driver/ledc.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "dlog.h"
+#include "trace.h"
+#include "metrics.h"
+#include "power_mgmt.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include <inttypes.h>
 
 //the values below are assigned based on SG90 datasheet
@@ -14,16 +22,51 @@
 #define MAX_DUTY 4096 // max duty cycle for 12 bit duty resolution
 
 #define SENSOR_THRESH 39
+#define SETTLE_US 600000 // worst case time for the servo to travel its full range
 
 
 static ledc_timer_config_t timer_config;
 static ledc_channel_config_t channel_config;
 static const char *TAG = "Vent Servo";
-static uint32_t current_duty;
+static DlogTag dlog_tag = DLOG_TAG_INIT("Vent Servo", 10);
+//user settings live in rtc memory so they survive away mode deep sleep
+static RTC_DATA_ATTR uint32_t current_duty = 0;
 
-static bool is_enabled = false;
-static bool is_auto = false;
+static RTC_DATA_ATTR bool is_enabled = true;
+static RTC_DATA_ATTR bool is_auto = false;
 static bool auto_on = false;
+static esp_timer_handle_t settle_timer;
+
+//esp_timer_stop does not wait for a callback that is already running, so a move and the
+//settle callback of the one before it can overlap. Both only decide under vent_lock and
+//call the ledc, pm locks and timer after leaving it. Every move bumps move_gen first, so a
+//callback deciding after that leaves the output alone. One that decided before is flagged
+//in stopping while it works, and the move applies itself again once it is done
+static portMUX_TYPE vent_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t move_gen = 0;
+static uint32_t armed_gen = 0; // move whose settle timer is running
+static int64_t settle_at = 0; // when the armed move is done, catches a callback that ran late from the move before
+static bool stopping = false; // a settle callback is stopping the output
+static uint32_t stops = 0; // settle callbacks that stopped it
+
+//the servo holds its position unpowered, so once it has settled the pulse can stop
+//this drops the pwm lock so the chip can light sleep with the vent parked
+static void vent_settled(void *arg){
+  portENTER_CRITICAL(&vent_lock);
+  //skip if a move is in flight or this callback belongs to one that was replaced
+  bool stop = armed_gen == move_gen && esp_timer_get_time() >= settle_at;
+  stopping = stop;
+  portEXIT_CRITICAL(&vent_lock);
+  if(!stop){
+    return;
+  }
+  ESP_ERROR_CHECK(ledc_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_1, 0));
+  power_mgmt_pwm_active(PM_PWM_VENT, false);
+  portENTER_CRITICAL(&vent_lock);
+  stopping = false;
+  stops++;
+  portEXIT_CRITICAL(&vent_lock);
+}
 
 void vent_init(){
   timer_config = (ledc_timer_config_t){
@@ -50,9 +93,12 @@ void vent_init(){
   ESP_LOGI(TAG, "Configuring LEDC Channel");
   ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
 
-  current_duty = 0;
-  is_enabled = true;
-  is_auto = false;
+  const esp_timer_create_args_t settle_args = {
+    .callback = vent_settled,
+    .name = "vent settle",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&settle_args, &settle_timer));
+
   // be sure to run ledc_fade_func_install(0); in main 
   //this allows the ledc to transition between duty cycle values smoothly
 }
@@ -70,8 +116,44 @@ uint32_t angle_to_duty(uint8_t angle){
 
 //sends duty to the ledc driver and updates the value output
 void update_vent_duty(uint32_t duty){
-  ESP_LOGI(TAG, "Servo set to %" PRIu32 " duty.", duty);
-  ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_1, duty, 0));
+  DLOGI(dlog_tag, "Servo set to %" PRIu32 " duty.", duty);
+  portENTER_CRITICAL(&vent_lock);
+  uint32_t gen = ++move_gen;
+  uint32_t stops_seen = stops;
+  portEXIT_CRITICAL(&vent_lock);
+  esp_timer_stop(settle_timer); // fails harmlessly when the timer is not running
+
+  bool arm = false;
+  while(1){
+    //updating the duty turns the output back on after a stop
+    power_mgmt_pwm_active(PM_PWM_VENT, true);
+    ESP_ERROR_CHECK(ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_1, duty, 0));
+    portENTER_CRITICAL(&vent_lock);
+    bool busy = stopping;
+    bool stopped = stops != stops_seen;
+    stops_seen = stops;
+    if(!busy && !stopped && gen == move_gen){ // a newer move arms its own timer
+      armed_gen = gen;
+      settle_at = esp_timer_get_time() + SETTLE_US;
+      arm = true;
+    }
+    portEXIT_CRITICAL(&vent_lock);
+    if(!busy && !stopped){
+      break;
+    }
+    //a callback that decided before this move may have stopped the output after it was set
+    while(busy){
+      vTaskDelay(1); // the esp_timer task finishes the stop in microseconds
+      portENTER_CRITICAL(&vent_lock);
+      busy = stopping;
+      portEXIT_CRITICAL(&vent_lock);
+    }
+  }
+  if(arm){
+    ESP_ERROR_CHECK(esp_timer_start_once(settle_timer, SETTLE_US));
+  }
+  TRACE(TRACE_ACTUATOR_COMMIT, TRACE_VENT);
+  metric_inc(METRIC_VENT_WRITES);
 }
 
 // fxn for manual control by user
@@ -107,10 +189,10 @@ void vent_toggle_auto(){
 void vent_toggle_enabled(){
   is_enabled = !is_enabled;
   if(is_enabled){
-    ESP_LOGI(TAG, "Vent has been enabled");
+    DLOGI(dlog_tag, "Vent has been enabled");
     update_vent_duty(current_duty); //update the last duty that was set by the user to the driver
   }else{
-    ESP_LOGI(TAG, "Vent has been disabled");
+    DLOGI(dlog_tag, "Vent has been disabled");
     uint8_t duty = angle_to_duty(0); //get duty for angle 0 (closed position)
     update_vent_duty(duty); // push duty directly to avoid overwriting user set duty
   }
@@ -118,7 +200,7 @@ void vent_toggle_enabled(){
 
 // if the sent in percentage is greater than the set threshold, turn the fan on, otherwise off
 void vent_send_sensor_pct(uint8_t sensor_pct){
-  ESP_LOGI(TAG, "Given %d", sensor_pct);
+  DLOGI(dlog_tag, "Given %d", sensor_pct);
   if((sensor_pct >= SENSOR_THRESH) != auto_on){
     auto_on = !auto_on;
   }
@@ -130,4 +212,17 @@ void vent_send_sensor_pct(uint8_t sensor_pct){
     } 
   }
   
+}
+
+//reapply the user settings after the output was parked for away mode
+void vent_resume(){
+  if(is_enabled && (auto_on || !is_auto)){
+    update_vent_duty(current_duty);
+  }
+}
+
+
+//move to the closed position without touching the user set angle
+void vent_close(){
+  update_vent_duty(angle_to_duty(0));
 }
\ No newline at end of file
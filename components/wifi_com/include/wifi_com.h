@@ -1,6 +1,26 @@
 #ifndef WIFI_COM_H
 #define WIFI_COM_H
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "sdkconfig.h"
+
+typedef void (*WifiTimeSyncHandler)(void);
+
+#if CONFIG_DESK_NETWORK
 int wifi_get_temp();
-void wifi_com_init();
+//network_events must be created by the caller (see the RTOS manifest in main)
+//nvs has to be initialized first, the wifi driver keeps its settings there
+void wifi_com_init(EventGroupHandle_t network_events);
+//handler runs on the lwip task after every sntp clock update
+void wifi_com_on_time_sync(WifiTimeSyncHandler handler);
+//restart the wifi driver from another task, for when a request is stuck on the old connection
+void wifi_com_restart();
+#else
+//offline profile, nothing here is linked
+static inline int wifi_get_temp(){ return -100; }
+static inline void wifi_com_init(EventGroupHandle_t network_events){}
+static inline void wifi_com_on_time_sync(WifiTimeSyncHandler handler){}
+static inline void wifi_com_restart(){}
+#endif
 #endif
\ No newline at end of file
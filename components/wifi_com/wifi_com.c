@@ -6,13 +6,16 @@
 #include "esp_netif.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "nvs_flash.h"
 #include "lwip/netdb.h"
 #include "cJSON.h"
 
 #include "esp_netif_sntp.h"
 
 #include "wifi_sta.h"
+#include "boot_timeline.h"
+#include "metrics.h"
+#include "power_mgmt.h"
+#include "esp_timer.h"
 
 #define RX_BUF_SIZE 1024
 
@@ -48,6 +51,7 @@ static struct addrinfo hints;
 static struct timeval sock_timeout;
 
 static esp_sntp_config_t config;
+static WifiTimeSyncHandler time_sync_handler = NULL;
 
 int parse_weather_json(const char *json_str) {
   cJSON *root = cJSON_Parse(json_str);
@@ -56,20 +60,29 @@ int parse_weather_json(const char *json_str) {
     return -100;
   }
 
+  //read the value before the tree is deleted, and delete it on every path
+  int temp = -100;
   cJSON *current_weather = cJSON_GetObjectItem(root, "current_weather");
   if (current_weather != NULL) {
     cJSON *temp_item = cJSON_GetObjectItem(current_weather, "temperature");
     if (cJSON_IsNumber(temp_item)) {
       ESP_LOGI(TAG, "Outside Temperature: %.1f°C", temp_item->valuedouble);
-      cJSON_Delete(root); 
-      return (int)round(temp_item->valuedouble);
+      temp = (int)round(temp_item->valuedouble);
     }
   }
-  return -100;
+  cJSON_Delete(root);
+  return temp;
   
 }
 
-void wifi_com_init(){
+//called from the lwip task every time sntp sets the clock, which can step it in either direction
+static void time_synced(struct timeval *tv){
+  if(time_sync_handler != NULL){
+    time_sync_handler();
+  }
+}
+
+void wifi_com_init(EventGroupHandle_t network_events){
 
 
   //Hints for DNS lookup
@@ -87,21 +100,8 @@ void wifi_com_init(){
   //Welcome message
   ESP_LOGI(TAG, "Starting Wifi Com");
 
-  //Initialize event group
-  network_event_group = xEventGroupCreate();
-
-  //Initialize NVS: ESP32 WiFi driver uses NVS to store WiFi settings
-  //Erase NVS partition if it's out of free space or new version
-  esp_ret = nvs_flash_init();
-  if((esp_ret == ESP_ERR_NVS_NO_FREE_PAGES) ||
-     (esp_ret == ESP_ERR_NVS_NEW_VERSION_FOUND)){
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    esp_ret = nvs_flash_init();
-  }
-  if(esp_ret != ESP_OK){
-    ESP_LOGE(TAG, "Error (%d): Could not initialize NVS", esp_ret);
-    abort();
-  } 
+  //Event group is statically allocated by the caller
+  network_event_group = network_events;
 
     // Initialize TCP/IP network interface (only call once in application)
     // Must be called prior to initializing the network driver!
@@ -125,13 +125,30 @@ void wifi_com_init(){
       ESP_LOGE(TAG, "Error (%d): Failed to initialize WiFi", esp_ret);
       abort();
   }
-
-  config = (esp_sntp_config_t)ESP_NETIF_SNTP_DEFAULT_CONFIG("pool.ntp.org");
-  esp_netif_sntp_init(&config);
+  boot_mark("wifi started");
 
   //set timezone to south bend time
+  //before sntp starts so local time is right by the first sync callback
   setenv("TZ","EST5EDT,M3.2.0/2,M11.1.0/2", 1);
   tzset();
+
+  config = (esp_sntp_config_t)ESP_NETIF_SNTP_DEFAULT_CONFIG("pool.ntp.org");
+  config.sync_cb = time_synced;
+  esp_netif_sntp_init(&config);
+  boot_mark("sntp started");
+}
+
+void wifi_com_on_time_sync(WifiTimeSyncHandler handler){
+  time_sync_handler = handler;
+}
+
+//the stuck task may be using the shared esp_ret, so this one keeps its own
+void wifi_com_restart(){
+  ESP_LOGW(TAG, "Restarting WiFi");
+  esp_err_t err = wifi_sta_reconnect();
+  if(err != ESP_OK){
+    ESP_LOGE(TAG, "Failed to restart WiFi (%d)", err);
+  }
 }
 
 
@@ -168,23 +185,8 @@ bool wait_for_connection(){
   return true;
 }
 
-int wifi_get_temp(){
-  network_event_bits = xEventGroupGetBits(network_event_group);
-  if (!(network_event_bits & WIFI_STA_CONNECTED_BIT) ||
-    !((network_event_bits & WIFI_STA_IPV4_OBTAINED_BIT) ||
-    (network_event_bits & WIFI_STA_IPV6_OBTAINED_BIT))) {
-    ESP_LOGI(TAG, "Network connection not established yet.");
-    if (!wait_for_connection(network_event_group, 
-                             CONNECTION_TIMEOUT_SEC)) {
-      ESP_LOGE(TAG, "Failed to connect to WiFi. Reconnecting...");
-      esp_ret = wifi_sta_reconnect();
-      if (esp_ret != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to reconnect WiFi (%d)", esp_ret);
-      }
-      return -100;
-    }
-  }
-
+//requests the current weather and returns the outside temperature, -100 on failure
+static int http_fetch_temp(){
   // DNS lookup
   ret = getaddrinfo(WEB_HOST, WEB_PORT, &hints, &dns_res);
   if(ret != 0 || dns_res == NULL){
@@ -212,6 +214,7 @@ int wifi_get_temp(){
   sock = socket(dns_res->ai_family, dns_res->ai_socktype, dns_res->ai_protocol);
   if(sock<0){
     ESP_LOGE(TAG, "Error (%d): Failed to create socket %s", errno, strerror(errno));
+    freeaddrinfo(dns_res);
     return -100;
   }
     
@@ -220,6 +223,7 @@ int wifi_get_temp(){
   if(ret < 0) {
     ESP_LOGE(TAG, "Error (%d): Failed to set socket send timeout: %s", errno, strerror(errno));
     close(sock);
+    freeaddrinfo(dns_res);
     return -100;
   }
 
@@ -228,21 +232,22 @@ int wifi_get_temp(){
   if(ret < 0) {
     ESP_LOGE(TAG, "Error (%d): Failed to set socket recieve timeout: %s", errno, strerror(errno));
     close(sock);
+    freeaddrinfo(dns_res);
     return -100;
   }
     
 
   //Connect to server
   ret = connect(sock, dns_res->ai_addr, dns_res->ai_addrlen);
+
+  //Delete the address info (prevents memory leaks), it is not needed once connect returns
+  freeaddrinfo(dns_res);
   if(ret < 0){
     ESP_LOGE(TAG, "Error (%d): Failed to connect to server: %s", errno, strerror(errno));
     close(sock);
     return -100;
   }
 
-  //Delete the address info (prevents memory leaks)
-  freeaddrinfo(dns_res);
-
   //Send HTTP GET
   ESP_LOGI(TAG, "Sending HTTP GET request...");
   ret = send(sock, REQUEST, strlen(REQUEST), 0 );
@@ -296,3 +301,32 @@ int wifi_get_temp(){
   return temp_result;
   
 }
+
+int wifi_get_temp(){
+  network_event_bits = xEventGroupGetBits(network_event_group);
+  if (!(network_event_bits & WIFI_STA_CONNECTED_BIT) ||
+    !((network_event_bits & WIFI_STA_IPV4_OBTAINED_BIT) ||
+    (network_event_bits & WIFI_STA_IPV6_OBTAINED_BIT))) {
+    ESP_LOGI(TAG, "Network connection not established yet.");
+    if (!wait_for_connection(network_event_group, 
+                             CONNECTION_TIMEOUT_SEC)) {
+      ESP_LOGE(TAG, "Failed to connect to WiFi. Reconnecting...");
+      esp_ret = wifi_sta_reconnect();
+      if (esp_ret != ESP_OK) {
+          ESP_LOGE(TAG, "Failed to reconnect WiFi (%d)", esp_ret);
+      }
+      return -100;
+    }
+  }
+
+  //time the whole request so slow dns or servers show up in the metrics
+  int64_t start = esp_timer_get_time();
+  power_mgmt_acquire(PM_WIFI); // run the request at full speed, then let the cpu drop back down
+  int temp = http_fetch_temp();
+  power_mgmt_release(PM_WIFI);
+  metric_observe(METRIC_HTTP_FETCH_US, (uint32_t)(esp_timer_get_time() - start));
+  if(temp == -100){
+    metric_inc(METRIC_HTTP_FAILED);
+  }
+  return temp;
+}
@@ -1,11 +1,15 @@
 #include "board.h"
 #include "rtos_setup.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include <time.h>
+#include <sys/time.h>
 
 //esp headders
 #include "esp_err.h"
 #include "esp_log.h"
+#include "dlog.h"
 #include "driver/gpio.h"
 #include "esp_timer.h"
 #include "driver/gptimer.h"
@@ -28,9 +32,28 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "spsc_ring.h"
 
 //wifi
 #include "wifi_com.h"
+#include "nvs_flash.h"
+
+//diagnostics
+#include "serial_cmd.h"
+#include "task_monitor.h"
+#include "trace.h"
+#include "metrics.h"
+#include "heap_profiler.h"
+
+//power
+#include "power_mgmt.h"
+#include "away_mode.h"
+
+//automation
+#include "rules.h"
+#include "schedule.h"
 
 
 #define NUM_ACTUATORS 3 
@@ -38,43 +61,102 @@
 #define ACTUATOR_MENU_LEN (NUM_ACTUATORS + 1)
 #define ACTION_MENU_LEN   (NUM_ACTIONS + 1)
 
-static const BaseType_t app_cpu = 1; //core for application purposes
-static const BaseType_t pro_cpu = 0; //wifi core
+//task handles, stacks and control blocks
+#define RTOS_TASK_STORAGE(handle, entry, name, stack, prio, core, stage) \
+  TaskHandle_t handle = NULL; \
+  static StackType_t handle##Stack[stack]; \
+  static StaticTask_t handle##Buffer;
+RTOS_TASKS(RTOS_TASK_STORAGE)
 
-//queue handles
-QueueHandle_t buttonQueue = NULL; //handles button interrupts to UI task
-QueueHandle_t controllerQueue = NULL; //handles messages sent to controller
-QueueHandle_t tempReadingQueue = NULL; //hanldes temp readings to UI for home display
-QueueSetHandle_t wifiDataQueue = NULL; //handles sending wifi collected data to UI for home display
+//queue handles and storage
+#define RTOS_QUEUE_STORAGE(handle, type, len) \
+  QueueHandle_t handle = NULL; \
+  static uint8_t handle##Storage[(len) * sizeof(type)]; \
+  static StaticQueue_t handle##Buffer;
+RTOS_QUEUES(RTOS_QUEUE_STORAGE)
 
 //mutexes
-SemaphoreHandle_t adcMutex = NULL;
-
-//Task Handles 
-TaskHandle_t userInterfaceTask = NULL;
-TaskHandle_t potentiometerSampleTask = NULL;
-TaskHandle_t tempPhotoSampleTask = NULL;
-
+#define RTOS_MUTEX_STORAGE(handle) \
+  SemaphoreHandle_t handle = NULL; \
+  static StaticSemaphore_t handle##Buffer;
+RTOS_MUTEXES(RTOS_MUTEX_STORAGE)
+
+//event groups
+#define RTOS_EVENT_GROUP_STORAGE(handle) \
+  EventGroupHandle_t handle = NULL; \
+  static StaticEventGroup_t handle##Buffer;
+RTOS_EVENT_GROUPS(RTOS_EVENT_GROUP_STORAGE)
+
+//event bus topics, only BUS_LATEST topics keep the newest value, picked by pasting the policy
+#define BUS_STORAGE_BUS_LATEST(topic, type) static type topic##Latest;
+#define BUS_STORAGE_BUS_FIFO(topic, type)
+#define BUS_STORAGE_BUS_NOTIFY(topic, type)
+#define BUS_LATEST_PTR_BUS_LATEST(topic) &topic##Latest
+#define BUS_LATEST_PTR_BUS_FIFO(topic) NULL
+#define BUS_LATEST_PTR_BUS_NOTIFY(topic) NULL
+#define BUS_TOPIC_STORAGE(topic, topic_name, type, policy) BUS_STORAGE_##policy(topic, type)
+BUS_TOPICS(BUS_TOPIC_STORAGE)
+#define BUS_TOPIC_DEF(topic, topic_name, type, topic_policy) \
+  [topic] = { .name = (topic_name), .size = sizeof(type), .policy = (topic_policy), .latest = BUS_LATEST_PTR_##topic_policy(topic) },
+static const BusTopicDef bus_topics[BUS_NUM_TOPICS] = { BUS_TOPICS(BUS_TOPIC_DEF) };
+
+#define SUPERVISED_DEF(id, part_name, heartbeat, latency, part_action, hook) \
+  [id] = { .name = (part_name), .heartbeat_ms = (heartbeat), .max_latency_ms = (latency), .action = (part_action), .restart = (hook) },
+static const SupervisedDef supervised[HEALTH_NUM_PARTS] = { SUPERVISED(SUPERVISED_DEF) };
+
+//the manifest must fit the budget and describe tasks the scheduler can actually run
+_Static_assert(configSUPPORT_STATIC_ALLOCATION, "static allocation must be enabled");
+_Static_assert(sizeof(StackType_t) == 1, "stack sizes in the manifest are in bytes");
+_Static_assert(RTOS_TOTAL_BYTES <= RTOS_STATIC_BUDGET_BYTES, "RTOS objects exceed RTOS_STATIC_BUDGET_BYTES");
+_Static_assert(BUS_NUM_TOPICS <= CONFIG_EVENT_BUS_MAX_TOPICS, "raise CONFIG_EVENT_BUS_MAX_TOPICS");
+#define RTOS_TASK_CHECK(handle, entry, name, stack, prio, core, stage) \
+  _Static_assert((stack) >= configMINIMAL_STACK_SIZE, name " stack is below the minimum"); \
+  _Static_assert((prio) < configMAX_PRIORITIES, name " priority is out of range"); \
+  _Static_assert((core) < portNUM_PROCESSORS, name " core does not exist");
+RTOS_TASKS(RTOS_TASK_CHECK)
 
 static char* TAG = "RTOS";
+static DlogTag dlog_tag = DLOG_TAG_INIT("RTOS", 5);
 
 
 static uint64_t last_button_time[2] = {0}; // array to hold dobounce times
 
+//isr to task hand off, each ring has exactly one isr pushing and one task popping
+SPSC_RING_DECLARE(ButtonRing, button_ring, ButtonEvent, BUTTON_RING_LEN)
+SPSC_RING_DECLARE(PotRing, pot_ring, uint32_t, POT_RING_LEN)
+static ButtonRing button_presses; // gpio isr to user_interface_task
+static PotRing pot_ticks; // pot timer isr to potentiometer_task, the value is the tick number
+#if CONFIG_LOAD_BENCH
+static ButtonRing bench_presses; // load bench to user_interface_task, a ring of its own keeps both single producer
+#endif
+
 /**************************************
  * Private function prototypes
  */
 void gpio_isr_handler(void* arg);
 bool signal_sample_pot(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx);
 void potentiometer_task(void *parameters);
+void start_up_display();
 void start_up();
+void create_rtos_objects();
+void subscribe_topics();
+void create_tasks(BootPart stage);
+void sample_temp_photo();
+void read_temp_photo(void *parameters);
+void settings_task(void *parameters);
+void wifi_task(void *parameters);
 void user_interface_task(void *parameters);
 void controller_task(void *parameters);
 
 //button interrupt function
 void IRAM_ATTR gpio_isr_handler(void* arg){
   ButtonEvent button_pressed = (ButtonEvent)(uintptr_t)arg;
-  uint64_t now = esp_timer_get_time() / 1000;
+  if(!power_mgmt_gpio_wake_pressed(button_pressed == BUTTON_1 ? BUT_1_PIN : BUT_2_PIN)){
+    return; // release of a wake pin
+  }
+  TRACE(TRACE_ISR_BUTTON, button_pressed);
+  int64_t now_us = esp_timer_get_time();
+  uint64_t now = now_us / 1000;
   BaseType_t task_woken = pdFALSE;
 
   int button_idx = button_pressed - 1;  // Assuming BUTTON_1=1, BUTTON_2=2
@@ -83,39 +165,69 @@ void IRAM_ATTR gpio_isr_handler(void* arg){
   }
   last_button_time[button_idx] = now;
 
-  xQueueSendToBackFromISR(buttonQueue, &button_pressed, &task_woken);
-  vTaskNotifyGiveFromISR(userInterfaceTask, &task_woken); //notify the ui task
+  if(button_ring_push(&button_presses, button_pressed, now_us)){
+    TRACE(TRACE_QUEUE_SEND, UI);
+  }else{
+    TRACE(TRACE_QUEUE_SEND_FAIL, UI);
+    metric_inc(METRIC_BUTTON_DROPPED);
+  }
+  if(userInterfaceTask != NULL){ // buttons work before the ui task exists, the press waits in the ring
+    vTaskNotifyGiveFromISR(userInterfaceTask, &task_woken);
+  }
   if(task_woken) portYIELD_FROM_ISR();
 
 }
 
 //signal the potentiometer_task 
 bool IRAM_ATTR signal_sample_pot(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx){
+  static uint32_t tick = 0;
   BaseType_t task_woken = pdFALSE;
+  TRACE(TRACE_ISR_POT_TIMER, 0);
+  if(!pot_ring_push(&pot_ticks, tick++, esp_timer_get_time())){
+    metric_inc(METRIC_POT_TICK_DROPPED);
+  }
   vTaskNotifyGiveFromISR(potentiometerSampleTask, &task_woken);
   return (task_woken == pdTRUE);
 }
 
-//startup function that will be called at the begeing of mcu running
+//light reading for away mode made before anything else is started
+static int away_read_light(){
+  photoresistor_init();
+  return read_photo_light();
+}
+
+//first boot stage: get a frame on the display before anything else
+void start_up_display(){
+  display_init();
+  homeScreen("", "", "");
+  boot_mark(BOOT_FIRST_FRAME);
+}
+
+//second boot stage: actuators, sensors and buttons
+//networking is brought up separately by wifi_task so it never holds this up
 void start_up(){
 
   //initialize peripherals
   indicator_init();
-  display_init();
   fan_init();
   lamp_init();
   vent_init();
+  boot_mark("actuators ready");
   potentiometer_init();
   buttons_init();
   photoresistor_init();
   temp_sensor_init();
-  wifi_com_init();
+  boot_mark("sensors ready");
 
 
   //set callback functions for button interrupts
   gpio_isr_handler_add(BUT_1_PIN, gpio_isr_handler, (void *)BUTTON_1);
   gpio_isr_handler_add(BUT_2_PIN, gpio_isr_handler, (void *)BUTTON_2);
 
+  //buttons have to be able to wake the chip from light sleep
+  power_mgmt_gpio_wakeup(BUT_1_PIN);
+  power_mgmt_gpio_wakeup(BUT_2_PIN);
+
 
   //install fade functionality for ledc driver
   ESP_ERROR_CHECK(ledc_fade_func_install(0));
@@ -134,9 +246,8 @@ void setup_isrs(){
   //register timer event callback function for sampling potentiometer values
   ESP_ERROR_CHECK(gptimer_register_event_callbacks(pot_timer, &pot_signal_callback, NULL));
 
-  //enable pot timer
-  //timer will be started and stopped from the 
-  ESP_ERROR_CHECK(gptimer_enable(pot_timer));
+  //pot timer is enabled and started from the controller only while adjusting
+  //an enabled gptimer holds a pm lock that would keep the chip out of light sleep
 }
 
 
@@ -145,84 +256,106 @@ void setup_isrs(){
 
 void potentiometer_task(void *parameters){
   while(1){
+    supervisor_end(HEALTH_POT);
     ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    supervisor_begin(HEALTH_POT);
+    //ticks that piled up while this task was held off all ask for the same reading
+    //a notification without a tick comes from the load bench
+    PotRingEntry tick;
+    bool ticked = false;
+    while(pot_ring_pop(&pot_ticks, &tick)){
+      ticked = true;
+    }
+    if(ticked){
+      metric_observe(METRIC_POT_LATENCY_US, esp_timer_get_time() - tick.time_us);
+    }
     //protect adc unit
     xSemaphoreTake(adcMutex, portMAX_DELAY);
     int pct = read_pot_pct();
     xSemaphoreGive(adcMutex);
     // ESP_LOGI(TAG, "Recieved pot reading of %d%%", pct);
-    //send to actuator task 
-    //actuator task will apply this value whereever it is relevant according to UI
-    ControllerMsg instruction = {
+    //the controller applies this value whereever it is relevant according to UI
+    SensorReading reading = {
       .pct = pct,
-      .sender_id = POTENTIOMETER,
     };
-    if(xQueueSendToBack(controllerQueue, &instruction, 0) == pdFAIL){
-      ESP_LOGI(TAG, "Failed to send potentiometer reading");
-    }
+    BUS_PUBLISH(TOPIC_INPUT_POT, &reading);
   } 
 }
 
-void read_temp_photo(void *parameters){
-  int sent_temp = 0;
-  while(1){
-
-    // ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-    xSemaphoreTake(adcMutex, portMAX_DELAY);
-    int reading = read_photo_light();
-    xSemaphoreGive(adcMutex);
-
-    ControllerMsg instruction = {
-      .pct = reading,
-      .sender_id = PHOTORESISTOR,
-    };
-    if(xQueueSendToBack(controllerQueue ,&instruction, 0) == pdFALSE){
-      ESP_LOGI(TAG, "Photoresistor reading dropped");
-    }
+//read the light and temperature sensors once and publish both
+void sample_temp_photo(){
+  xSemaphoreTake(adcMutex, portMAX_DELAY);
+  SensorReading light = {
+    .pct = read_photo_light(),
+  };
+  xSemaphoreGive(adcMutex);
+  BUS_PUBLISH(TOPIC_SENSOR_LIGHT, &light);
 
-    xSemaphoreTake(adcMutex, portMAX_DELAY);
-    reading = read_temp_pct();
-    xSemaphoreGive(adcMutex);
+  xSemaphoreTake(adcMutex, portMAX_DELAY);
+  SensorReading temp = {
+    .pct = read_temp_pct(),
+    .deg = read_temp_deg(),
+  };
+  xSemaphoreGive(adcMutex);
+  BUS_PUBLISH(TOPIC_SENSOR_TEMP, &temp);
+  metric_set(METRIC_INSIDE_TEMP, temp.deg);
+}
 
-    //send temp sensor as a percentage to controller task
-    instruction.pct = reading;
-    instruction.sender_id = TEMP_SENSOR;
-    if(xQueueSendToBack(controllerQueue ,&instruction, 0) == pdFALSE){
-      ESP_LOGI(TAG, "Temperature reading dropped");
-    }
+void read_temp_photo(void *parameters){
+  while(1){
+    supervisor_begin(HEALTH_SENSORS);
+    sample_temp_photo();
+    supervisor_end(HEALTH_SENSORS);
 
-    xSemaphoreTake(adcMutex, portMAX_DELAY);
-    reading = read_temp_deg();
-    xSemaphoreGive(adcMutex);
-    if(reading != sent_temp){
-      TempReading tempReading = {
-        .temp = reading,
-      };
-      
-      if(xQueueSendToFront(tempReadingQueue, &tempReading, 0) == pdFALSE){
-        ESP_LOGI(TAG, "Temperature degree reading dropped");
-      }else{
-        sent_temp = reading;
-      }
-    }
-    
+    //while away these readings are the periodic presence check, so they slow right down
+    //a notification takes an extra reading straight away, the load bench sends those
+    ulTaskNotifyTake(pdTRUE, away_mode_sample_period_ms(1000) / portTICK_PERIOD_MS);
 
-    //send temp sensor as a temperature to UI task if different from sent_temp
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+  }
+}
 
+//nvs holds the saved rules and schedule, and the wifi driver settings
+static void load_settings(){
+  //Erase NVS partition if it's out of free space or new version
+  esp_err_t err = nvs_flash_init();
+  if(err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND){
+    ESP_ERROR_CHECK(nvs_flash_erase());
+    err = nvs_flash_init();
   }
+  ESP_ERROR_CHECK(err);
+  boot_mark("nvs ready");
+  rules_load();
+  schedule_load();
+}
+
+//offline builds have only the settings to bring up in the background
+void settings_task(void *parameters){
+  load_settings();
+  boot_timeline_complete(BOOT_NETWORK);
+  vTaskDelete(NULL);
 }
 
 void wifi_task(void *parameters){
   WifiData wifiData = {0};
 
+  //nvs, wifi and sntp come up here in the background while the local controls start
+  load_settings();
+  wifi_com_init(networkEventGroup);
+  boot_timeline_complete(BOOT_NETWORK);
+
   while(1){
-    int temp = wifi_get_temp();
+    //nobody is there to read the weather while away
+    int temp = -100;
+    if(!away_mode_is_away()){
+      //a request stuck past its deadline gets wifi restarted underneath it
+      supervisor_begin(HEALTH_NETWORK);
+      temp = wifi_get_temp();
+      supervisor_end(HEALTH_NETWORK);
+    }
     if(temp != -100){
       wifiData.temp = temp;
-      if(xQueueSendToFront(wifiDataQueue, &wifiData, 0)== pdFALSE){
-        ESP_LOGI(TAG, "Wifi data dropped");
-      }
+      metric_set(METRIC_OUTSIDE_TEMP, temp);
+      BUS_PUBLISH(TOPIC_WEATHER_OUTSIDE, &wifiData);
     }
     
     vTaskDelay(60000 / portTICK_PERIOD_MS);
@@ -231,203 +364,564 @@ void wifi_task(void *parameters){
 }
 
 
-// handles all user interface display functionality and interactions
+/**************************************
+ * User interface
+ * An explicit state machine fed one event at a time: button presses, away mode changes,
+ * published data and a tick at the next deadline, the clock turning over a minute, a trend
+ * column or a menu timing out. Between those the task sleeps. No handler waits on anything
+ * but a full controller queue, and then only briefly, so every event is handled in bounded time.
+ */
+
+#define UI_SEND_WAIT_MS 100 // a full controller queue drops the instruction instead of stalling the ui
+#define UI_TIMEOUT_US ((int64_t)CONFIG_UI_MENU_TIMEOUT_S * 1000000)
+#define UI_TREND_US ((int64_t)CONFIG_UI_TREND_COLUMN_S * 1000000)
+
+typedef enum {
+  UI_HOME = 0,
+  UI_ACTUATOR_MENU = 1,
+  UI_ACTION_MENU = 2,
+  UI_MODE = 3,
+  UI_TOGGLE = 4,
+  UI_ADJUST = 5,
+  UI_AWAY = 6, // display blank until a press or the controller ends away mode
+} UiState;
+
+typedef enum {
+  UI_EVENT_BUTTON = 0,
+  UI_EVENT_AWAY = 1, // away mode started or ended
+  UI_EVENT_DATA = 2, // a reading or actuator state the screens show was published
+  UI_EVENT_TICK = 3,
+} UiEventKind;
+
+typedef struct {
+  UiEventKind kind;
+  ButtonEvent button;
+} UiEvent;
+
+typedef struct {
+  UiState state;
+  int selected; // menu item with the cursor
+  const MenuItem *actuator; // chosen in the actuator menu
+  bool setting; // auto in the mode screen, enabled in the toggle screen
+  int64_t last_press_us;
+  bool away_seen; // away mode as of the last away event
+
+  //newest readings, fetched from the bus on every data event and tick whatever the screen
+  SensorReading inside;
+  WifiData outside;
+  uint32_t inside_seen;
+  uint32_t outside_seen;
+  //formatted once per change of the value behind them
+  char inside_temp[5];
+  char outside_temp[5];
+  char cur_time[6];
+  int inside_shown;
+  int outside_shown;
+  int minute_shown; // of the day
+  int64_t next_minute_us;
+  //inside readings since the last trend column, averaged into it
+  int trend_sum;
+  int trend_readings;
+  int64_t next_trend_us;
+} UiContext;
+
+//menu items carry the actuator or action they choose
+static const MenuItem actuator_items[ACTUATOR_MENU_LEN] = {
+  {"Fan",  FAN},
+  {"Vent", VENT},
+  {"Lamp", LAMP},
+  {"Exit", ACTUATOR_NA},
+};
+static const Menu actuator_menu = { actuator_items, ACTUATOR_MENU_LEN };
+
+static const MenuItem action_items[ACTION_MENU_LEN] = {
+  {"Mode",   MODE},
+  {"Toggle", TOGGLE},
+  {"Adjust", ADJUST},
+  {"Exit",   ACTION_NA},
+};
+static const Menu action_menu = { action_items, ACTION_MENU_LEN };
+
+static bool clock_stepped = false; // sntp set the clock, the minute on screen may be wrong
+
+//next button press from the isr ring
+//every press is also published for anything else that wants to know about it
+static bool pop_press(ButtonEvent *pressed){
+  ButtonRingEntry entry;
+  bool popped = false;
+#if CONFIG_LOAD_BENCH
+  popped = button_ring_pop(&bench_presses, &entry);
+#endif
+  if(!popped && !button_ring_pop(&button_presses, &entry)){
+    return false;
+  }
+  metric_observe(METRIC_BUTTON_LATENCY_US, esp_timer_get_time() - entry.time_us);
+  *pressed = entry.value;
+  BUS_PUBLISH(TOPIC_INPUT_BUTTON, pressed);
+  return true;
+}
+
+//the earliest deadline a tick has to handle
+static int64_t ui_next_tick(const UiContext *ui){
+  int64_t next = ui->next_minute_us < ui->next_trend_us ? ui->next_minute_us : ui->next_trend_us;
+  if(ui->state != UI_HOME && ui->state != UI_AWAY){
+    int64_t timeout = ui->last_press_us + UI_TIMEOUT_US;
+    next = timeout < next ? timeout : next;
+  }
+  return next;
+}
 
-void user_interface_task(void *parameters){
+//the next event in order of urgency, waiting for one only when there is nothing to handle
+//the button isr, the controller and the bus topics the ui subscribes to all notify it
+static void ui_next_event(UiContext *ui, UiEvent *event){
+  bool woken = false;
+  while(1){
+    if(pop_press(&event->button)){
+      event->kind = UI_EVENT_BUTTON;
+      return;
+    }
+    if(away_mode_is_away() != ui->away_seen){
+      ui->away_seen = !ui->away_seen;
+      event->kind = UI_EVENT_AWAY;
+      return;
+    }
+    if(woken){
+      event->kind = UI_EVENT_DATA;
+      return;
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t next_tick_us = ui_next_tick(ui);
+    if(now >= next_tick_us){
+      event->kind = UI_EVENT_TICK; // the tick handler moves every deadline it meets on
+      return;
+    }
+    supervisor_end(HEALTH_UI); // waiting for an event is not work
+    woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((next_tick_us - now) / 1000) + 1) > 0;
+    supervisor_begin(HEALTH_UI);
+  }
+}
 
-  MenuItem actuator_menu[ACTUATOR_MENU_LEN] = {
-    {"Fan",false}, 
-    {"Vent", false},
-    {"Lamp", false},
-    {"Exit", false},
-  };
+//every message to the controller is stamped so its time in the queue can be measured
+static BaseType_t controller_send(ControllerMsg *msg, TickType_t wait){
+  msg->sent_us = esp_timer_get_time();
+  return xQueueSendToBack(controllerQueue, msg, wait);
+}
 
-  Actuator_Id actuator_id_arr[ACTUATOR_MENU_LEN] = {
-    FAN,
-    VENT,
-    LAMP,
-    ACTUATOR_NA,
-  };
-  
-  MenuItem action_menu[ACTION_MENU_LEN] = {
-    {"Mode",false}, 
-    {"Toggle", false},
-    {"Adjust", false},
-    {"Exit", false},
+static void ui_send(Actuator_Id actuator, Action_Id action){
+  ControllerMsg instruction = {
+    .action_id = action,
+    .actuator_id = actuator,
+    .sender_id = UI,
   };
+  if(controller_send(&instruction, pdMS_TO_TICKS(UI_SEND_WAIT_MS)) == pdFALSE){
+    TRACE(TRACE_QUEUE_SEND_FAIL, UI);
+    DLOGI(dlog_tag, "UI instruction dropped");
+  }else{
+    TRACE(TRACE_QUEUE_SEND, UI);
+  }
+}
 
-  Action_Id action_id_arr[ACTION_MENU_LEN] = {
-    MODE,
-    TOGGLE,
-    ADJUST,
-    ACTION_NA,
-  };
-  
-
-  //variables needed for UI logic
-  int selected_idx = 0;
-  Actuator_Id chosen_actuator = ACTUATOR_NA;
-  Action_Id chosen_action = ACTION_NA;
-  
-  //variable to store what button was pressed
-  ButtonEvent pressed = NA;
-  //stores temp reading from temp sensor
-  TempReading tempReading = {0};
-  WifiData wifiData = {0};
+//tell the controller someone is at the desk, this also ends away mode
+static void ui_activity(){
+  ui_send(ACTUATOR_NA, ACTION_NA);
+}
 
-  time_t current_time;
-  struct tm *tm_local;
+static bool actuator_is_auto(Actuator_Id actuator){
+  switch(actuator){
+    case(FAN):
+      return get_fan_is_auto();
+    case(VENT):
+      return get_vent_is_auto();
+    case(LAMP):
+      return get_lamp_is_auto();
+    default:
+      ESP_LOGI(TAG, "Unhandled acutator ID in MODE case");
+      return false;
+  }
+}
 
-  char inside_temp[5] = "";
-  char outside_temp[5] = "";
-  char cur_time_str[6] = "";
+static bool actuator_is_enabled(Actuator_Id actuator){
+  switch(actuator){
+    case(FAN):
+      return get_fan_is_enabled();
+    case(VENT):
+      return get_vent_is_enabled();
+    case(LAMP):
+      return get_lamp_is_enabled();
+    default:
+      ESP_LOGI(TAG, "Unhandled acutator ID in TOGGLE case");
+      return false;
+  }
+}
 
+//the screens skip the frame when nothing they show changed, so this is cheap to repeat
+static void ui_draw(UiContext *ui){
+  switch(ui->state){
+    case(UI_HOME):
+      homeScreen(ui->inside_temp, ui->outside_temp, ui->cur_time);
+      break;
+    case(UI_ACTUATOR_MENU):
+      displayMenu(&actuator_menu, ui->selected);
+      break;
+    case(UI_ACTION_MENU):
+      displayMenu(&action_menu, ui->selected);
+      break;
+    case(UI_MODE):
+      displayMode(ui->actuator, ui->setting);
+      break;
+    case(UI_TOGGLE):
+      displayToggle(ui->actuator, ui->setting);
+      break;
+    case(UI_ADJUST):
+      displayAdjust(ui->actuator);
+      break;
+    case(UI_AWAY):
+      break;
+  }
+}
 
-  while(1){
-    homeScreen(inside_temp, outside_temp, cur_time_str);
-    // check the button queue for 1 sec and then refresh the screen
-    while(xQueueReceive(buttonQueue, &pressed, pdMS_TO_TICKS(1000)) == pdFALSE){ 
-      //scan wifi and temp queue
-      if(xQueueReceive(tempReadingQueue, &tempReading, 0) == pdTRUE ||
-         xQueueReceive(wifiDataQueue, &wifiData, 0) == pdTRUE){
-        //copy temps to strings from most recent data recieved
-        snprintf(inside_temp, sizeof(inside_temp),"%d", tempReading.temp);
-        snprintf(outside_temp, sizeof(outside_temp), "%d", wifiData.temp);
+static void ui_enter(UiContext *ui, UiState state){
+  if(ui->state == UI_ADJUST){
+    ui_send(ui->actuator->id, ADJUST); // the second adjust message stops the pot sampling
+  }
+  ui->state = state;
+  ui->selected = 0;
+  if(state == UI_MODE){
+    ui->setting = actuator_is_auto(ui->actuator->id);
+  }else if(state == UI_TOGGLE){
+    ui->setting = actuator_is_enabled(ui->actuator->id);
+  }else if(state == UI_ADJUST){
+    ui_send(ui->actuator->id, ADJUST); // the controller starts sampling the pot
+  }
+  ui_draw(ui);
+}
 
+//button 1 selects, button 2 moves down or flips the setting on screen
+static void ui_press(UiContext *ui, ButtonEvent pressed){
+  ui->last_press_us = esp_timer_get_time();
+  switch(ui->state){
+    case(UI_HOME):
+      ui_activity();
+      ui_enter(ui, UI_ACTUATOR_MENU);
+      break;
+    case(UI_ACTUATOR_MENU):
+      if(pressed == BUTTON_2){
+        ui->selected = (ui->selected + 1) % ACTUATOR_MENU_LEN;
+        ui_draw(ui);
+      }else if(actuator_items[ui->selected].id == ACTUATOR_NA){
+        ui_enter(ui, UI_HOME);
+      }else{
+        ui->actuator = &actuator_items[ui->selected];
+        ui_enter(ui, UI_ACTION_MENU);
       }
-      //get local time
-      current_time = time(NULL);
-      tm_local = localtime(&current_time);
-      snprintf(cur_time_str, sizeof(cur_time_str), "%d:%d", tm_local->tm_hour, tm_local->tm_min);
+      break;
+    case(UI_ACTION_MENU):
+      if(pressed == BUTTON_2){
+        ui->selected = (ui->selected + 1) % ACTION_MENU_LEN;
+        ui_draw(ui);
+        break;
+      }
+      switch(action_items[ui->selected].id){
+        case(MODE):
+          ui_enter(ui, UI_MODE);
+          break;
+        case(TOGGLE):
+          ui_enter(ui, UI_TOGGLE);
+          break;
+        case(ADJUST):
+          ui_enter(ui, UI_ADJUST);
+          break;
+        default:
+          ui_enter(ui, UI_HOME);
+          break;
+      }
+      break;
+    case(UI_MODE):
+    case(UI_TOGGLE):
+      if(pressed == BUTTON_2){
+        //the controller flips the setting, the screen shows the flip straight away
+        ui->setting = !ui->setting;
+        ui_send(ui->actuator->id, ui->state == UI_MODE ? MODE : TOGGLE);
+        ui_draw(ui);
+      }else{
+        ui_enter(ui, UI_HOME);
+      }
+      break;
+    case(UI_ADJUST):
+      ui_enter(ui, UI_HOME);
+      break;
+    case(UI_AWAY):
+      //the press that wakes the display is not passed on to the menus
+      ui_activity();
+      display_power(true);
+      ui_enter(ui, UI_HOME);
+      break;
+  }
+}
 
+//blank the display while away, a press or the controller ending away mode brings it back
+static void ui_away(UiContext *ui){
+  if(ui->away_seen && ui->state != UI_AWAY){
+    ui_enter(ui, UI_AWAY);
+    display_power(false);
+    away_mode_deep_sleep(); // only returns when light sleep is used instead
+  }else if(!ui->away_seen && ui->state == UI_AWAY){
+    display_power(true);
+    ui_enter(ui, UI_HOME);
+  }
+}
 
-      //refresh screen
-      homeScreen(inside_temp, outside_temp, cur_time_str);
+//one column of the home screen trend, the mean of the inside readings since the last one
+static void ui_trend(UiContext *ui){
+  if(ui->next_trend_us == 0){ // the first column is a full period after start up
+    ui->next_trend_us = esp_timer_get_time() + UI_TREND_US;
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+  ui->next_trend_us += UI_TREND_US;
+  if(ui->next_trend_us < now){ // ticks were held up, carry on from here rather than catch up
+    ui->next_trend_us = now + UI_TREND_US;
+  }
+  int16_t inside = TREND_NONE;
+  if(ui->trend_readings > 0){
+    inside = ui->trend_sum / ui->trend_readings;
+  }
+  int16_t outside = TREND_NONE;
+#if CONFIG_UI_TREND_OUTSIDE
+  if(ui->outside_seen != 0){
+    outside = ui->outside.temp * 10;
+  }
+#endif
+  homeTrend(inside, outside);
+  ui->trend_sum = 0;
+  ui->trend_readings = 0;
+}
 
+//a new reading of the same temperature keeps its string
+static void ui_format_temp(char *text, size_t len, int *shown, int deg){
+  if(text[0] == '\0' || deg != *shown){
+    snprintf(text, len, "%d", deg);
+    *shown = deg;
+  }
+}
 
-    }
-    // MENU 1: ACTUATORS ///////////////////////
-    selected_idx = 0;
-    actuator_menu[selected_idx].selected = true;
-    displayMenu(actuator_menu, ACTUATOR_MENU_LEN);
-    pressed = NA;
-    while(pressed != BUTTON_1){ // while the select button is not pressed
-      if(xQueueReceive(buttonQueue, &pressed, portMAX_DELAY) == pdTRUE){
-        if(pressed == BUTTON_2){ // this is the down or move button
-          actuator_menu[selected_idx].selected = false;
-          selected_idx = (selected_idx+1) % ACTUATOR_MENU_LEN;
-          actuator_menu[selected_idx].selected = true;
-          displayMenu(actuator_menu, ACTUATOR_MENU_LEN);
-        }
-      }
-    }
-    //reset the current menu and shared resources for the next menu
-    chosen_actuator = actuator_id_arr[selected_idx];
-    actuator_menu[selected_idx].selected = false;
-
-    //If exit was chosen, restart
-    if (chosen_actuator == ACTUATOR_NA) continue;
-  
-    // MENU 2: ACTIONS ///////////////////////
-    selected_idx = 0;
-    action_menu[selected_idx].selected = true;
-    displayMenu(action_menu, ACTION_MENU_LEN);
-
-    pressed = NA;
-    // loop will run if an actuator was chosen from the previos menu ie exit was not chosen
-    while(pressed != BUTTON_1){ 
-      if(xQueueReceive(buttonQueue, &pressed, portMAX_DELAY) == pdTRUE){
-        if(pressed == BUTTON_2){ // this is the down or move button
-          action_menu[selected_idx].selected = false;
-          selected_idx = (selected_idx+1) % ACTION_MENU_LEN;
-          action_menu[selected_idx].selected = true;
-          displayMenu(action_menu, ACTION_MENU_LEN);
-        }
-      }
-    }
-    chosen_action = action_id_arr[selected_idx];
-    action_menu[selected_idx].selected = false;
-    
-    // If Exit was chosen, restart
-    if(chosen_action == ACTION_NA) continue;
-    
+//the time on screen only changes on a minute boundary, so the ui sleeps until the next one
+static void ui_clock(UiContext *ui){
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  struct tm tm_local;
+  localtime_r(&now.tv_sec, &tm_local);
+  int minute = tm_local.tm_hour * 60 + tm_local.tm_min;
+  if(ui->cur_time[0] == '\0' || minute != ui->minute_shown){
+    snprintf(ui->cur_time, sizeof(ui->cur_time), "%02d:%02d", tm_local.tm_hour, tm_local.tm_min);
+    ui->minute_shown = minute;
+  }
+  //waking a little early only finds the same minute and sleeps the rest of the way
+  ui->next_minute_us = esp_timer_get_time() + (int64_t)(60 - tm_local.tm_sec) * 1000000 - now.tv_usec;
+}
 
-    // //INTERFACE WITH CONTROLLER BASED ON DATA
-    pressed = NA;
-    //construct a instruction for the controller with input data
-    ControllerMsg instruction = {
-      .action_id = chosen_action,
-      .actuator_id = chosen_actuator,
-      .sender_id = UI
-    };
+//sntp steps the clock either way, the schedule and the time on screen both follow it
+static void time_synced(){
+  schedule_recompute();
+  __atomic_store_n(&clock_stepped, true, __ATOMIC_RELAXED);
+  if(userInterfaceTask != NULL){ // before it starts the ui reads the clock first thing anyway
+    xTaskNotifyGive(userInterfaceTask);
+  }
+}
 
-    switch(chosen_action){
-      case (MODE):
-        //query the respective driver for its mode 
-        bool is_auto = NULL;
-        if(chosen_actuator == FAN){
-          is_auto = get_fan_is_auto();
-        }else if(chosen_actuator == VENT){
-          is_auto = get_vent_is_auto();
-        }else if(chosen_actuator == LAMP){
-          is_auto = get_lamp_is_auto();
-        }else{
-          ESP_LOGI(TAG, "Unhandled acutator ID in MODE case");
-        }
-        //send a message to the controller to update the output of of the given actuator 
-        displayMode(actuator_menu[chosen_actuator], is_auto);
-        while(pressed != BUTTON_1){ 
-          if(xQueueReceive(buttonQueue, &pressed, portMAX_DELAY) == pdTRUE){
-            if(pressed == BUTTON_2){ // only toggle auto/manual if button 2 (down) is pressed
-              is_auto = !is_auto;
-              xQueueSendToBack(controllerQueue, &instruction, portMAX_DELAY);
-              displayMode(actuator_menu[chosen_actuator], is_auto);
-            }
-          }
-        }
-        break;
-      case(TOGGLE):
-        //get current enable status from chosen driver
-        bool enabled = NULL;
-        if(chosen_actuator == FAN){
-          enabled = get_fan_is_enabled();
-        }else if(chosen_actuator == VENT){
-          enabled = get_vent_is_enabled();
-        }else if(chosen_actuator == LAMP){
-          enabled = get_lamp_is_enabled();
-        }else{
-          ESP_LOGI(TAG, "Unhandled acutator ID in TOGGLE case");
-        }
-        displayToggle(actuator_menu[chosen_actuator], enabled);
-        //query the respective driver for its mode 
-        //send a message to the controller to update the output of of the given actuator 
-        while(pressed != BUTTON_1){ 
-          if(xQueueReceive(buttonQueue, &pressed, portMAX_DELAY) == pdTRUE){
-            if(pressed == BUTTON_2){ // only toggle on/off if button 2 (down) is pressed
-              enabled = !enabled;
-              xQueueSendToBack(controllerQueue, &instruction, portMAX_DELAY);
-              displayToggle(actuator_menu[chosen_actuator], enabled);
-            }
-          }
-        }
+//live data is kept current in every state, so home is up to date the moment it is shown
+//readings that did not change leave every string and the screen as they were
+static void ui_refresh(UiContext *ui, bool tick){
+  if(BUS_READ(TOPIC_SENSOR_TEMP, &ui->inside, &ui->inside_seen)){
+    ui_format_temp(ui->inside_temp, sizeof(ui->inside_temp), &ui->inside_shown, ui->inside.deg);
+    ui->trend_sum += ui->inside.deg * 10;
+    ui->trend_readings++;
+  }
+  if(BUS_READ(TOPIC_WEATHER_OUTSIDE, &ui->outside, &ui->outside_seen)){
+    ui_format_temp(ui->outside_temp, sizeof(ui->outside_temp), &ui->outside_shown, ui->outside.temp);
+  }
+  int64_t now = esp_timer_get_time();
+  if(__atomic_exchange_n(&clock_stepped, false, __ATOMIC_RELAXED) || (tick && now >= ui->next_minute_us)){
+    ui_clock(ui);
+  }
+  if(tick && now >= ui->next_trend_us){
+    ui_trend(ui);
+  }
+
+  //rules, the schedule and away mode change actuators behind the screen's back
+  if(ui->state == UI_MODE){
+    ui->setting = actuator_is_auto(ui->actuator->id);
+  }else if(ui->state == UI_TOGGLE){
+    ui->setting = actuator_is_enabled(ui->actuator->id);
+  }
+
+  bool idle = now - ui->last_press_us >= UI_TIMEOUT_US;
+  if(tick && idle && ui->state != UI_HOME && ui->state != UI_AWAY){
+    ui_enter(ui, UI_HOME);
+  }else{
+    ui_draw(ui);
+  }
+}
+
+void user_interface_task(void *parameters){
+  static UiContext ui = {
+    .state = UI_HOME,
+  };
+  //anything the screens show wakes the ui when it is published
+  const BusTopic shown_topics[] = {TOPIC_SENSOR_TEMP, TOPIC_WEATHER_OUTSIDE, TOPIC_ACTUATOR_STATE};
+  for(int i = 0; i < sizeof(shown_topics) / sizeof(shown_topics[0]); i++){
+    ESP_ERROR_CHECK(event_bus_subscribe_task(shown_topics[i], xTaskGetCurrentTaskHandle()));
+  }
+
+  while(1){
+    UiEvent event;
+    ui_next_event(&ui, &event);
+    switch(event.kind){
+      case(UI_EVENT_BUTTON):
+        ui_press(&ui, event.button);
         break;
-      case (ADJUST):
-        displayAdjust(actuator_menu[chosen_actuator]);
-        //send data to controller and the controller will start sampling
-        xQueueSendToBack(controllerQueue, &instruction, portMAX_DELAY);
-        while(pressed != BUTTON_1 && pressed != BUTTON_2){ 
-          if(xQueueReceive(buttonQueue, &pressed, portMAX_DELAY) == pdTRUE){
-            //send data to the controller again and it will stop sampling
-            xQueueSendToBack(controllerQueue, &instruction, portMAX_DELAY);
-          }
-        }
+      case(UI_EVENT_AWAY):
+        ui_away(&ui);
         break;
-      case (ACTION_NA):
-        //do nothing, program should never trigger this
+      case(UI_EVENT_DATA):
+      case(UI_EVENT_TICK):
+        ui_refresh(&ui, event.kind == UI_EVENT_TICK);
         break;
     }
-  
-    
+  }
+}
+
+//park the actuators when away mode starts and restore the user settings when it ends
+//the ui is notified either way so it can blank or wake the display
+static void apply_away(AwayChange change){
+  if(change == AWAY_ENTER){
+    fan_off();
+    lamp_off();
+    vent_close();
+  }else if(change == AWAY_LEAVE){
+    fan_resume();
+    lamp_resume();
+    vent_resume();
+  }else{
+    return;
+  }
+  for(Actuator_Id actuator = FAN; actuator <= LAMP; actuator++){
+    BUS_PUBLISH(TOPIC_ACTUATOR_STATE, &actuator);
+  }
+  xTaskNotifyGive(userInterfaceTask);
+}
+
+//rules and the schedule both set an actuator to a percentage
+static const Actuator_Id rule_actuators[RULE_NUM_TARGETS] = {
+  [RULE_FAN] = FAN,
+  [RULE_VENT] = VENT,
+  [RULE_LAMP] = LAMP,
+};
+static const Actuator_Id schedule_actuators[SCHEDULE_NUM_TARGETS] = {
+  [SCHEDULE_FAN] = FAN,
+  [SCHEDULE_VENT] = VENT,
+  [SCHEDULE_LAMP] = LAMP,
+};
+
+static void set_actuator_pct(Actuator_Id actuator, int pct){
+  switch(actuator){
+    case(FAN):
+      fan_set_speed(pct);
+      break;
+    case(VENT):
+      vent_set_angle((pct*180)/100);
+      break;
+    case(LAMP):
+      lamp_set_brightness(pct);
+      break;
+    default:
+      return;
+  }
+  BUS_PUBLISH(TOPIC_ACTUATOR_STATE, &actuator);
+}
+
+//keep the rule inputs current and run the rules, called once per controller cycle
+static void run_rules(const ControllerMsg *msg, RuleSnapshot *snapshot){
+  if(msg->sender_id == PHOTORESISTOR){
+    rule_snapshot_set(snapshot, RULE_IN_LIGHT, msg->pct);
+  }else if(msg->sender_id == TEMP_SENSOR){
+    rule_snapshot_set(snapshot, RULE_IN_TEMP, msg->pct);
+    rule_snapshot_set(snapshot, RULE_IN_INSIDE, msg->deg);
+  }else if(msg->sender_id == WEATHER){
+    rule_snapshot_set(snapshot, RULE_IN_OUTSIDE, msg->deg);
+  }
+  time_t now = time(NULL);
+  struct tm tm_local;
+  localtime_r(&now, &tm_local);
+  if(tm_local.tm_year > 120){ // the clock has been set by sntp
+    rule_snapshot_set(snapshot, RULE_IN_HOUR, tm_local.tm_hour);
+  }
+
+  RuleAction actions[CONFIG_RULES_MAX];
+  int num_actions = rules_evaluate(snapshot, actions, CONFIG_RULES_MAX);
+  for(int i = 0; i < num_actions; i++){
+    set_actuator_pct(rule_actuators[actions[i].target], actions[i].pct);
+  }
+}
+
+//runs on the esp_timer task, so the event is handed to the controller like any other input
+static void schedule_fire(ScheduleTarget target, uint8_t pct){
+  ControllerMsg instruction = {
+    .actuator_id = schedule_actuators[target],
+    .pct = pct,
+    .sender_id = SCHEDULE,
+  };
+  if(controller_send(&instruction, 0) == pdFALSE){
+    TRACE(TRACE_QUEUE_SEND_FAIL, SCHEDULE);
+    metric_inc(METRIC_SCHEDULE_DROPPED);
+    DLOGI(dlog_tag, "Scheduled event dropped");
+  }else{
+    TRACE(TRACE_QUEUE_SEND, SCHEDULE);
+  }
+}
+
+//sensor topics reach the controller through its queue, tagged with the sender they came from
+typedef struct {
+  Sender_Id sender;
+  MetricCounter dropped;
+} ControllerInput;
+
+static const ControllerInput controller_inputs[BUS_NUM_TOPICS] = {
+  [TOPIC_SENSOR_TEMP]     = {TEMP_SENSOR,   METRIC_TEMP_DROPPED},
+  [TOPIC_SENSOR_LIGHT]    = {PHOTORESISTOR, METRIC_PHOTO_DROPPED},
+  [TOPIC_INPUT_POT]       = {POTENTIOMETER, METRIC_POT_DROPPED},
+  [TOPIC_WEATHER_OUTSIDE] = {WEATHER,       METRIC_WEATHER_DROPPED}, // rules compare against the outside temperature
+};
+
+//bus callback, runs in the publishing task
+static void forward_to_controller(int topic, const void *payload, void *ctx){
+  const ControllerInput *input = ctx;
+  ControllerMsg instruction = {
+    .sender_id = input->sender,
+  };
+  if(topic == TOPIC_WEATHER_OUTSIDE){
+    instruction.deg = ((const WifiData *)payload)->temp;
+  }else{
+    const SensorReading *reading = payload;
+    instruction.pct = reading->pct;
+    instruction.deg = reading->deg;
+  }
+  if(controller_send(&instruction, 0) == pdFALSE){
+    TRACE(TRACE_QUEUE_SEND_FAIL, input->sender);
+    metric_inc(input->dropped);
+    DLOGI(dlog_tag, "Reading from sender %d dropped", input->sender);
+  }else{
+    TRACE(TRACE_QUEUE_SEND, input->sender);
+  }
+}
+
+//wire consumers to their topics, producers are unaware of any of this
+void subscribe_topics(){
+  event_bus_init(bus_topics, BUS_NUM_TOPICS);
+  const BusTopic controller_topics[] = {TOPIC_SENSOR_TEMP, TOPIC_SENSOR_LIGHT, TOPIC_INPUT_POT, TOPIC_WEATHER_OUTSIDE};
+  for(int i = 0; i < sizeof(controller_topics) / sizeof(controller_topics[0]); i++){
+    BusTopic topic = controller_topics[i];
+    ESP_ERROR_CHECK(event_bus_subscribe_callback(topic, forward_to_controller, (void *)&controller_inputs[topic]));
   }
 }
 
@@ -435,8 +929,18 @@ void user_interface_task(void *parameters){
 void controller_task(void *parameters){
   ControllerMsg rec_instruct = {0};
   Actuator_Id cur_adjust = ACTUATOR_NA; // holds ID of whichever actuator potentiometers should be sent to
+  RuleSnapshot rule_inputs = {0};
   while(1){
+    supervisor_end(HEALTH_CONTROLLER);
     if(xQueueReceive(controllerQueue, &rec_instruct, portMAX_DELAY) == pdTRUE){ // make sure queue item is recieved
+      supervisor_begin(HEALTH_CONTROLLER);
+      TRACE(TRACE_QUEUE_RECV, rec_instruct.sender_id);
+      metric_observe(METRIC_CONTROLLER_LATENCY_US, esp_timer_get_time() - rec_instruct.sent_us);
+      metric_set(METRIC_CONTROLLER_DEPTH, uxQueueMessagesWaiting(controllerQueue));
+      TRACE(TRACE_CONTROLLER_BEGIN, rec_instruct.sender_id);
+      if(rec_instruct.sender_id == POTENTIOMETER || rec_instruct.sender_id == UI){
+        apply_away(away_mode_activity());
+      }
       if(rec_instruct.sender_id == POTENTIOMETER){
         int percent = rec_instruct.pct;
         //shift extreme values to 0 or 100
@@ -446,20 +950,7 @@ void controller_task(void *parameters){
           percent = 0;
         }
         set_level_indicator_from_pct(percent);
-        switch(cur_adjust){
-          case(FAN):
-            fan_set_speed(percent);
-            break;
-          case(VENT):
-            uint8_t angle = (percent*180)/100;
-            vent_set_angle(angle);
-            break;
-          case(LAMP):
-            lamp_set_brightness(percent);
-            break;
-          default:
-            //do nothing
-        }
+        set_actuator_pct(cur_adjust, percent);
       }else if(rec_instruct.sender_id == UI){ // detect a message from the UI
         switch(rec_instruct.action_id){ // switch based on which action the user took
           ///////// MODE SWITCH
@@ -476,6 +967,7 @@ void controller_task(void *parameters){
                 break;
               default:
             }            
+            BUS_PUBLISH(TOPIC_ACTUATOR_STATE, &rec_instruct.actuator_id);
             break;
           ///////// TOGGLE switch
           case(TOGGLE):
@@ -491,116 +983,253 @@ void controller_task(void *parameters){
                 break;
               default:
             }            
+            BUS_PUBLISH(TOPIC_ACTUATOR_STATE, &rec_instruct.actuator_id);
             break;
           case(ADJUST):
             if(cur_adjust == ACTUATOR_NA){
               cur_adjust = rec_instruct.actuator_id;
+              ESP_ERROR_CHECK(gptimer_enable(pot_timer));
               ESP_ERROR_CHECK(gptimer_start(pot_timer));
             }else{
               cur_adjust = ACTUATOR_NA;
               ESP_ERROR_CHECK(gptimer_stop(pot_timer));
+              ESP_ERROR_CHECK(gptimer_disable(pot_timer));
               set_level_indicator(0);
             }
 
+            break;
+          case(ACTION_NA):
+            //activity only, handled by away mode above
             break;
           default:
             ESP_LOGE(TAG, "Controller case unhandled.");
         } 
       }else if(rec_instruct.sender_id == PHOTORESISTOR){
-        lamp_send_sensor_pct(rec_instruct.pct);
-      }else if(rec_instruct.sender_id == TEMP_SENSOR){
+        apply_away(away_mode_light(rec_instruct.pct));
+        if(!away_mode_is_away()){ // parked actuators ignore their sensors
+          lamp_send_sensor_pct(rec_instruct.pct);
+        }
+      }else if(rec_instruct.sender_id == TEMP_SENSOR && !away_mode_is_away()){
         //do nothing
         vent_send_sensor_pct(rec_instruct.pct);
         fan_send_sensor_pct(rec_instruct.pct);
+      }else if(rec_instruct.sender_id == SCHEDULE && !away_mode_is_away()){
+        set_actuator_pct(rec_instruct.actuator_id, rec_instruct.pct);
+      }
+      if(!away_mode_is_away()){
+        run_rules(&rec_instruct, &rule_inputs);
       }
+      TRACE(TRACE_CONTROLLER_END, rec_instruct.sender_id);
     }
     
   }
 }
 
 
-void app_main() {
-  start_up();
+#if CONFIG_LOAD_BENCH
+/**************************************
+ * Load benchmark
+ * Drives the real pot, button and sensor paths at the configured rates from the
+ * console task, then reports per core utilization and latencies over the run.
+ */
+
+#define BENCH_STEP_MS 10 // every rate is a whole number of steps per second, up to 100 Hz
+#define BENCH_SETTLE_MS (CONFIG_TASK_MONITOR_INTERVAL_MS * 2) // queued work drains and the task monitor catches up before the report
+
+static MetricsSnapshot bench_before; // too big for the console task stack
+static MetricsSnapshot bench_after;
+
+//every input that reaches the controller through its queue
+static const MetricCounter bench_queue_drops[] = {
+  METRIC_POT_DROPPED,
+  METRIC_PHOTO_DROPPED,
+  METRIC_TEMP_DROPPED,
+  METRIC_WEATHER_DROPPED,
+  METRIC_SCHEDULE_DROPPED,
+};
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+//run time of each core's idle task and of the system, read at both ends of the run
+typedef struct {
+  uint32_t idle[portNUM_PROCESSORS];
+  uint32_t total;
+} BenchRuntime;
+
+static void bench_runtime(BenchRuntime *runtime){
+  for(int core = 0; core < portNUM_PROCESSORS; core++){
+    TaskStatus_t idle;
+    vTaskGetInfo(xTaskGetIdleTaskHandleForCore(core), &idle, pdFALSE, eInvalid);
+    runtime->idle[core] = (uint32_t)idle.ulRunTimeCounter;
+  }
+  runtime->total = (uint32_t)portGET_RUN_TIME_COUNTER_VALUE();
+}
+
+//share of each core its idle task did not get between the two readings
+static void bench_print_utilization(const BenchRuntime *start, const BenchRuntime *end){
+  uint32_t elapsed = end->total - start->total; // counters wrap, unsigned subtraction does not mind
+  for(int core = 0; core < portNUM_PROCESSORS; core++){
+    uint32_t idle = end->idle[core] - start->idle[core];
+    uint32_t busy_tenths = elapsed > 0 && idle < elapsed ? (uint32_t)(((uint64_t)(elapsed - idle) * 1000) / elapsed) : 0;
+    printf("core %d busy %3" PRIu32 ".%" PRIu32 "%%\n", core, busy_tenths / 10, busy_tenths % 10);
+  }
+}
+#else
+typedef struct {
+  int unused;
+} BenchRuntime;
+
+static void bench_runtime(BenchRuntime *runtime){}
 
-  //setup handles for queues
-  buttonQueue = xQueueCreate(BUTTON_QUEUE_LEN, sizeof(ButtonEvent));
-  if(buttonQueue == NULL){
-    ESP_LOGE(TAG, "Failed to create buttonQueue");
+static void bench_print_utilization(const BenchRuntime *start, const BenchRuntime *end){
+  printf("core utilization needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n");
+}
+#endif
+
+//adds hz to a phase accumulator each step and says whether this step should fire
+static bool bench_due(int *phase, int hz){
+  *phase += hz;
+  if(*phase >= 1000 / BENCH_STEP_MS){
+    *phase -= 1000 / BENCH_STEP_MS;
+    return true;
   }
-  controllerQueue = xQueueCreate(CONTROLLER_QUEUE_LEN, sizeof(ControllerMsg));
-  if(controllerQueue == NULL){
-    ESP_LOGE(TAG, "Failed to create controllerQueue");
+  return false;
+}
+
+static void bench_print_latency(const char *name, MetricHistogram id){
+  const MetricHistogramData *before = &bench_before.histograms[id];
+  const MetricHistogramData *after = &bench_after.histograms[id];
+  uint32_t count = after->count - before->count;
+  uint32_t mean = count > 0 ? (after->sum_us - before->sum_us) / count : 0;
+  printf("%-22s %8" PRIu32 " samples, mean %6" PRIu32 " us, max since boot %7" PRIu32 " us\n", name, count, mean, after->max_us);
+}
+
+static void bench_cmd(const char *args){
+  int seconds = atoi(args);
+  if(seconds <= 0){
+    seconds = 20;
   }
-  tempReadingQueue = xQueueCreate(1, sizeof(TempReading));
-  if(tempReadingQueue == NULL){
-    ESP_LOGE(TAG, "Failed to create tempReadingQueue");
+  printf("Bench: %d s, pot %d Hz, buttons %d Hz, sensors %d Hz\n", seconds,
+         CONFIG_LOAD_BENCH_POT_HZ, CONFIG_LOAD_BENCH_BUTTON_HZ, CONFIG_LOAD_BENCH_SENSOR_HZ);
+  metrics_snapshot(&bench_before);
+  BenchRuntime run_start;
+  BenchRuntime run_end;
+  bench_runtime(&run_start);
+
+  int pot_phase = 0;
+  int button_phase = 0;
+  int sensor_phase = 0;
+  TickType_t last_wake = xTaskGetTickCount();
+  for(int step = 0; step < seconds * (1000 / BENCH_STEP_MS); step++){
+    if(bench_due(&pot_phase, CONFIG_LOAD_BENCH_POT_HZ)){
+      xTaskNotifyGive(potentiometerSampleTask);
+    }
+    if(bench_due(&button_phase, CONFIG_LOAD_BENCH_BUTTON_HZ)){
+      //down only, so the ui walks the actuator menu without choosing anything
+      button_ring_push(&bench_presses, BUTTON_2, esp_timer_get_time());
+      xTaskNotifyGive(userInterfaceTask);
+    }
+    if(bench_due(&sensor_phase, CONFIG_LOAD_BENCH_SENSOR_HZ)){
+      xTaskNotifyGive(tempPhotoSampleTask);
+    }
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(BENCH_STEP_MS));
   }
-  wifiDataQueue = xQueueCreate(1, sizeof(WifiData));
-  if(wifiDataQueue == NULL){
-    ESP_LOGE(TAG, "Failed to create wifiDataQueue");
+  //read before the settle wait, which would otherwise count as idle time
+  bench_runtime(&run_end);
+
+  vTaskDelay(pdMS_TO_TICKS(BENCH_SETTLE_MS));
+  metrics_snapshot(&bench_after);
+  task_monitor_report();
+  bench_print_utilization(&run_start, &run_end);
+  bench_print_latency("controller.latency_us", METRIC_CONTROLLER_LATENCY_US);
+  bench_print_latency("pot.sample_latency_us", METRIC_POT_LATENCY_US);
+  bench_print_latency("ui.button_latency_us", METRIC_BUTTON_LATENCY_US);
+  bench_print_latency("display.draw_us", METRIC_DISPLAY_DRAW_US);
+  bench_print_latency("display.flush_us", METRIC_DISPLAY_FLUSH_US);
+  uint32_t drops = 0;
+  for(int i = 0; i < sizeof(bench_queue_drops) / sizeof(bench_queue_drops[0]); i++){
+    drops += bench_after.counters[bench_queue_drops[i]] - bench_before.counters[bench_queue_drops[i]];
+  }
+  printf("controller queue drops %" PRIu32 "\n", drops);
+}
+#endif
+
+//create every queue, mutex and event group from the static storage in the manifest
+//these cannot fail at runtime, so the system is never left half initialized
+void create_rtos_objects(){
+#define RTOS_QUEUE_CREATE(handle, type, len) \
+  handle = xQueueCreateStatic((len), sizeof(type), handle##Storage, &handle##Buffer); \
+  configASSERT(handle);
+  RTOS_QUEUES(RTOS_QUEUE_CREATE)
+
+#define RTOS_MUTEX_CREATE(handle) \
+  handle = xSemaphoreCreateMutexStatic(&handle##Buffer); \
+  configASSERT(handle);
+  RTOS_MUTEXES(RTOS_MUTEX_CREATE)
+
+#define RTOS_EVENT_GROUP_CREATE(handle) \
+  handle = xEventGroupCreateStatic(&handle##Buffer); \
+  configASSERT(handle);
+  RTOS_EVENT_GROUPS(RTOS_EVENT_GROUP_CREATE)
+}
+
+//start every task in the manifest that belongs to the given boot stage on its assigned core
+void create_tasks(BootPart boot_stage){
+#define RTOS_TASK_CREATE(handle, entry, name, stack, prio, core, stage) \
+  if((stage) == boot_stage){ \
+    handle = xTaskCreateStaticPinnedToCore(entry, name, (stack), NULL, (prio), handle##Stack, &handle##Buffer, (core)); \
+    configASSERT(handle); \
+    task_monitor_register(handle, (stack)); \
   }
+  RTOS_TASKS(RTOS_TASK_CREATE)
+}
+
+
+void app_main() {
+  boot_mark("app_main");
+
+  //configure dfs before any driver takes a pm lock
+  power_mgmt_init();
+
+  //a timer wake from away deep sleep only checks the lights, and sleeps again if nothing changed
+  AwayBoot away_boot = away_mode_boot(away_read_light);
 
+  create_rtos_objects();
+  ESP_LOGI(TAG, "Reserved %d bytes for RTOS objects.", (int)RTOS_TOTAL_BYTES);
+  //consumers are subscribed before any task that publishes is started
+  subscribe_topics();
+  //heartbeats count from here, the supervisor task itself starts with the local tasks
+  supervisor_init(supervised, HEALTH_NUM_PARTS);
 
-  //create mutex
-  adcMutex = xSemaphoreCreateMutex();
-  if(adcMutex == NULL){
-    ESP_LOGE(TAG, "Failed to create adcMutex");
+  start_up_display();
+
+  //the schedule is loaded by wifi_task, it and the clock on screen follow every sntp clock update
+  schedule_init(scheduleMutex, schedule_fire);
+  wifi_com_on_time_sync(time_synced);
+
+  //start networking, or only the settings in offline builds, in the background, nothing below waits for it
+  create_tasks(BOOT_NETWORK);
+
+  start_up();
+  if(away_boot == AWAY_BOOT_RESUME){
+    fan_resume();
+    lamp_resume();
+    vent_resume();
   }
+  trace_init();
+  metrics_init();
+  heap_profiler_init();
+  away_mode_init();
+#if CONFIG_LOAD_BENCH
+  serial_cmd_register("bench", "'bench <seconds>' drives pot, button and sensor load and reports core use and latency", bench_cmd);
+#endif
+  rules_init();
 
   ESP_LOGI(TAG, "Creating Tasks.");
-
-  xTaskCreatePinnedToCore(
-    controller_task,
-    "Controller Task",
-    2048,
-    NULL,
-    2,
-    NULL,
-    app_cpu
-  );
-
-  xTaskCreatePinnedToCore(
-    user_interface_task,
-    "User Interface",
-    2048,
-    NULL,
-    1,
-    &userInterfaceTask,
-    app_cpu
-  );
-
-  xTaskCreatePinnedToCore(
-    potentiometer_task,
-    "Pot Read",
-    4096,
-    NULL,
-    4,
-    &potentiometerSampleTask,
-    app_cpu
-  );
-
-  xTaskCreatePinnedToCore(
-    read_temp_photo,
-    "Read Temp and Photo",
-    2048,
-    NULL,
-    3,
-    &tempPhotoSampleTask,
-    app_cpu
-  );
-
-  xTaskCreatePinnedToCore(
-    wifi_task,
-    "Get Temp from Wifi",
-    8192,
-    NULL,
-    1,
-    NULL,
-    pro_cpu
-
-  );
+  create_tasks(BOOT_LOCAL);
 
   setup_isrs();
+  boot_mark(BOOT_FIRST_CONTROL);
+  boot_timeline_complete(BOOT_LOCAL);
 
   vTaskDelete(NULL);
-}
\ No newline at end of file
+}
@@ -2,12 +2,24 @@
 #define RTOS_SETUP_H
 
 #include "freertos/FreeRTOS.h"
+#include "buttons.h"
+#include "boot_timeline.h"
+#include "event_bus.h"
+#include "supervisor.h"
+#include "sdkconfig.h"
 
-#define BUTTON_QUEUE_LEN 1
+#define BUTTON_RING_LEN 8 // presses the ui task has not handled yet, a power of two
+#define POT_RING_LEN 4 // pot sample ticks, a power of two
 #define CONTROLLER_QUEUE_LEN 10
 
 #define DEBOUNCE_TIME_MS 250
 
+//sensors are sampled every second, or every away check interval while away
+#define SENSOR_HEARTBEAT_MS (CONFIG_AWAY_MODE_CHECK_INTERVAL_S * 1000 + 5000)
+
+#define PRO_CPU 0 //wifi core
+#define APP_CPU 1 //core for application purposes
+
 // enums correlate with menu items
 typedef enum {
   FAN = 0,
@@ -23,6 +35,8 @@ typedef enum {
   POTENTIOMETER = 2,
   PHOTORESISTOR = 3,
   TEMP_SENSOR = 4,
+  WEATHER = 5,
+  SCHEDULE = 6,
 } Sender_Id;
 
 
@@ -39,20 +53,148 @@ typedef struct {
   Action_Id action_id; 
   Sender_Id sender_id; 
   int pct; //used by ADC tasks
+  int deg; //used by temperature readings
+  int64_t sent_us; //set by controller_send
 } ControllerMsg;
 
 
 
-//the below structs are seperate to make adding a wifi data value easier in the future
+//payload of the sensor topics, deg is only filled in by the temperature sensor
 typedef struct{
-  int temp;  
-} TempReading;
+  int pct;
+  int deg;
+} SensorReading;
 
+//the below structs are seperate to make adding a wifi data value easier in the future
 typedef struct{
   int temp;
 } WifiData;
 
 
+/**************************************
+ * RTOS resource manifest
+ * Every task, queue, mutex and event group the application uses is listed here and
+ * backed by static storage in main.c, so all RTOS memory is reserved at link time.
+ */
+
+//X(handle, entry function, name, stack bytes, priority, core, boot stage)
+//BOOT_NETWORK tasks start as soon as the first frame is up, BOOT_LOCAL tasks once local peripherals are ready
+//APP_CPU is the control core: controller, pot and sensors. The ui and the display render stage that sends
+//its frames would hold up control decisions there, so they share PRO_CPU with networking and diagnostics instead.
+//the render stage outranks the ui so a finished frame starts on the bus while the next one is drawn
+//use the "bench" command (CONFIG_LOAD_BENCH) to compare placements
+//the supervisor outranks every task it watches so a busy one cannot hold up its checks
+//the build profile (main/Kconfig.projbuild) decides which background and diagnostic tasks exist
+#define RTOS_TASKS(X) \
+  X(controllerTask,          controller_task,     "Controller Task",     3072, 2, APP_CPU, BOOT_LOCAL) \
+  X(userInterfaceTask,       user_interface_task, "User Interface",      2048, 1, PRO_CPU, BOOT_LOCAL) \
+  RTOS_DISPLAY_TASKS(X) \
+  X(potentiometerSampleTask, potentiometer_task,  "Pot Read",            4096, 4, APP_CPU, BOOT_LOCAL) \
+  X(tempPhotoSampleTask,     read_temp_photo,     "Read Temp and Photo", 2048, 3, APP_CPU, BOOT_LOCAL) \
+  RTOS_BACKGROUND_TASKS(X) \
+  X(serialCmdTask,           serial_cmd_task,     "Serial Cmd",          3072, 1, PRO_CPU, BOOT_LOCAL) \
+  RTOS_DIAGNOSTIC_TASKS(X) \
+  X(logDrainTask,            dlog_drain_task,     "Log Drain",           3072, 1, PRO_CPU, BOOT_LOCAL) \
+  X(supervisorTask,          supervisor_task,     "Supervisor",          2560, 5, PRO_CPU, BOOT_LOCAL)
+
+#if CONFIG_DESK_NETWORK
+//wifi_com_restart is the only restart hook in SUPERVISED, it tears the wifi driver down and
+//brings it back up. That runs on the restart task, not on the supervisor's own small stack
+#define RTOS_BACKGROUND_TASKS(X) \
+  X(wifiTask,                wifi_task,           "Get Temp from Wifi",  8192, 1, PRO_CPU, BOOT_NETWORK) \
+  X(restartTask,             supervisor_restart_task, "Restart",         4096, 4, PRO_CPU, BOOT_NETWORK)
+#else
+//loads the saved settings and deletes itself
+#define RTOS_BACKGROUND_TASKS(X) \
+  X(settingsTask,            settings_task,       "Load Settings",       3072, 1, PRO_CPU, BOOT_NETWORK)
+#endif
+
+#if CONFIG_DISPLAY_BUFFER_FULL
+#define RTOS_DISPLAY_TASKS(X) \
+  X(displayRenderTask,       display_render_task, "Display Render",      2048, 2, PRO_CPU, BOOT_LOCAL)
+#else
+//page mode draws and sends on the ui task, there is no frame to hand over
+#define RTOS_DISPLAY_TASKS(X)
+#endif
+
+#if CONFIG_DESK_DIAGNOSTICS
+#define RTOS_DIAGNOSTIC_TASKS(X) \
+  X(taskMonitorTask,         task_monitor_task,   "Task Monitor",        3072, 1, PRO_CPU, BOOT_LOCAL)
+#else
+#define RTOS_DIAGNOSTIC_TASKS(X)
+#endif
+
+//X(handle, item type, length)
+//each queue is the mailbox of the task that reads it, ISRs hand data over in rings instead (see main.c)
+#define RTOS_QUEUES(X) \
+  X(controllerQueue,  ControllerMsg, CONTROLLER_QUEUE_LEN)
+
+//X(handle)
+#define RTOS_MUTEXES(X) \
+  X(adcMutex) \
+  X(scheduleMutex)
+
+//X(handle)
+#define RTOS_EVENT_GROUPS(X) \
+  X(networkEventGroup)
+
+//X(topic, name, payload type, delivery policy)
+//producers publish to a topic and never see its consumers, see event_bus.h for the policies
+#define BUS_TOPICS(X) \
+  X(TOPIC_SENSOR_TEMP,     "sensor.temp",     SensorReading, BUS_LATEST) \
+  X(TOPIC_SENSOR_LIGHT,    "sensor.light",    SensorReading, BUS_LATEST) \
+  X(TOPIC_INPUT_POT,       "input.pot",       SensorReading, BUS_LATEST) \
+  X(TOPIC_WEATHER_OUTSIDE, "weather.outside", WifiData,      BUS_LATEST) \
+  X(TOPIC_INPUT_BUTTON,    "input.button",    ButtonEvent,   BUS_NOTIFY) \
+  X(TOPIC_ACTUATOR_STATE,  "actuator.state",  Actuator_Id,   BUS_NOTIFY)
+
+//X(id, name, heartbeat ms, max job ms, action, restart hook)
+//a job is the work a task does between two waits, see supervisor.h
+//tasks that wait on input have no heartbeat, a stuck one shows up as a job past its deadline
+#define SUPERVISED(X) \
+  X(HEALTH_CONTROLLER, "controller", 0,                   500,   SUPERVISE_CRITICAL, NULL) \
+  X(HEALTH_UI,         "ui",         0,                   500,   SUPERVISE_CRITICAL, NULL) \
+  X(HEALTH_POT,        "pot",        0,                   200,   SUPERVISE_CRITICAL, NULL) \
+  X(HEALTH_SENSORS,    "sensors",    SENSOR_HEARTBEAT_MS, 500,   SUPERVISE_CRITICAL, NULL) \
+  X(HEALTH_NETWORK,    "network",    0,                   60000, SUPERVISE_RESTART,  wifi_com_restart)
+
+//upper bound on memory reserved for RTOS objects, checked at compile time in main.c
+#define RTOS_STATIC_BUDGET_BYTES (42 * 1024)
+
+//helpers used to total the manifest at compile time
+#define RTOS_TASK_BYTES(handle, entry, name, stack, prio, core, stage) + (stack) + sizeof(StaticTask_t)
+#define RTOS_QUEUE_BYTES(handle, type, len) + ((len) * sizeof(type)) + sizeof(StaticQueue_t)
+#define RTOS_MUTEX_BYTES(handle) + sizeof(StaticSemaphore_t)
+#define RTOS_EVENT_GROUP_BYTES(handle) + sizeof(StaticEventGroup_t)
+
+#define RTOS_TOTAL_BYTES (0 RTOS_TASKS(RTOS_TASK_BYTES) \
+                            RTOS_QUEUES(RTOS_QUEUE_BYTES) \
+                            RTOS_MUTEXES(RTOS_MUTEX_BYTES) \
+                            RTOS_EVENT_GROUPS(RTOS_EVENT_GROUP_BYTES))
+
+#define HEALTH_PART_ID(id, name, heartbeat, latency, action, restart) id,
+typedef enum { SUPERVISED(HEALTH_PART_ID) HEALTH_NUM_PARTS } HealthPart;
+#undef HEALTH_PART_ID
+
+#define BUS_TOPIC_ID(topic, name, type, policy) topic,
+typedef enum { BUS_TOPICS(BUS_TOPIC_ID) BUS_NUM_TOPICS } BusTopic;
+#undef BUS_TOPIC_ID
+
+#define BUS_TOPIC_TYPE(topic, name, type, policy) typedef type topic##_payload;
+BUS_TOPICS(BUS_TOPIC_TYPE)
+#undef BUS_TOPIC_TYPE
+
+//publish and read with the payload type checked against the manifest at compile time
+#define BUS_CHECK(topic, payload) \
+  _Static_assert(__builtin_types_compatible_p(__typeof__(*(payload)), topic##_payload), #topic " payload type")
+#define BUS_PUBLISH(topic, payload) \
+  ({ BUS_CHECK(topic, payload); event_bus_publish((topic), (payload)); })
+#define BUS_PUBLISH_FROM_ISR(topic, payload, task_woken) \
+  ({ BUS_CHECK(topic, payload); event_bus_publish_from_isr((topic), (payload), (task_woken)); })
+#define BUS_READ(topic, out, seen) \
+  ({ BUS_CHECK(topic, out); event_bus_read((topic), (out), (seen)); })
+
+
 void gpio_isr_handler(void* arg);
 
-#endif
\ No newline at end of file
+#endif
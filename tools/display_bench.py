@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Compare the display buffer modes by RAM footprint and frame time.
+
+Run from the project root inside an ESP-IDF environment:
+
+    tools/display_bench.py
+    tools/display_bench.py --port /dev/ttyUSB0 --seconds 20
+
+Each mode is built into build/display-<mode> on top of the telemetry profile
+with the load benchmark enabled. DRAM comes from idf.py size, so it includes the
+frame buffers and the render task the full mode adds. With --port every mode is
+also flashed and the "bench" console command is run. Its button presses redraw a
+menu, which gives the mean time a screen holds the ui task (draw) and the mean
+time a frame takes on the bus (flush). The full-nocache mode is the full mode
+drawing its text with u8g2_DrawStr, so its draw time against full is what the
+glyph cache saves per frame.
+
+Without a board, tools/display_sim builds the same modes for the host, and
+display_sim_full against display_sim_full_nocache gives the same comparison per
+screen update.
+"""
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+MODES = {
+    "full": ["DISPLAY_BUFFER_FULL=y"],
+    "full-nocache": ["DISPLAY_BUFFER_FULL=y", "DISPLAY_GLYPH_CACHE=n"],
+    "page2": ["DISPLAY_BUFFER_PAGE_2=y"],
+    "page1": ["DISPLAY_BUFFER_PAGE_1=y"],
+}
+PROFILE = "telemetry"  # the load bench needs the diagnostics only this profile has
+LATENCIES = {"draw": "display.draw_us", "flush": "display.flush_us"}
+BENCH_DONE = "controller queue drops"  # last line the bench prints
+BOOT_DONE = "Time to first control"
+BOOT_TIMEOUT_S = 30
+
+
+def build_dir(mode):
+    return os.path.join("build", "display-" + mode)
+
+
+def idf(mode, *args, capture=False):
+    out = build_dir(mode)
+    os.makedirs(out, exist_ok=True)
+    fragment = os.path.join(out, "sdkconfig.display")
+    with open(fragment, "w") as f:
+        f.writelines("CONFIG_%s\n" % option for option in MODES[mode] + ["LOAD_BENCH=y"])
+    cmd = ["idf.py", "-B", out,
+           "-D", "SDKCONFIG=" + os.path.join(out, "sdkconfig"),
+           "-D", "SDKCONFIG_DEFAULTS=sdkconfig.defaults;sdkconfig.%s;%s" % (PROFILE, fragment)] + list(args)
+    result = subprocess.run(cmd, check=True, stdout=subprocess.PIPE if capture else None,
+                            universal_newlines=True)
+    return result.stdout
+
+
+def size_json(mode, fmt):
+    # idf.py prints its own progress lines ahead of the report
+    text = idf(mode, "size", "--format", fmt, capture=True)
+    return json.loads(text[text.index("{"):])
+
+
+def dram_bytes(mode):
+    """DRAM in use, from either esp-idf-size json2 or the older idf_size json."""
+    try:
+        size = size_json(mode, "json2")
+        return {region["name"]: region["used"] for region in size["layout"]}.get("DRAM", 0)
+    except (subprocess.CalledProcessError, ValueError, KeyError):
+        return size_json(mode, "json")["used_dram"]
+
+
+def read_until(console, text, timeout_s):
+    lines = []
+    deadline = time.time() + timeout_s
+    while time.time() < deadline:
+        line = console.readline().decode(errors="replace")
+        lines.append(line)
+        if text in line:
+            return lines
+    sys.exit("gave up waiting for '%s'" % text)
+
+
+def frame_times(mode, port, seconds):
+    """Flash the mode, run the load bench and read the mean display latencies."""
+    import serial  # part of the esp-idf python environment
+
+    idf(mode, "-p", port, "flash")
+    found = {}
+    with serial.Serial(port, 115200, timeout=1) as console:
+        # same reset sequence as idf.py monitor
+        console.dtr = False
+        console.rts = True
+        time.sleep(0.1)
+        console.rts = False
+        read_until(console, BOOT_DONE, BOOT_TIMEOUT_S)
+        console.write(("bench %d\n" % seconds).encode())
+        for line in read_until(console, BENCH_DONE, seconds + BOOT_TIMEOUT_S):
+            for key, name in LATENCIES.items():
+                match = re.search(re.escape(name) + r"\s+(\d+) samples, mean\s+(\d+) us", line)
+                if match and int(match.group(1)) > 0:
+                    found[key] = int(match.group(2))
+    return found
+
+
+def ms(us):
+    return "-" if us is None else "%.2f" % (us / 1000)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-p", "--port", help="serial port of a board to measure frame times on")
+    parser.add_argument("-s", "--seconds", type=int, default=20, help="length of each bench run")
+    parser.add_argument("modes", nargs="*", help="modes to compare, all of them by default")
+    args = parser.parse_args()
+    unknown = set(args.modes) - set(MODES)
+    if unknown:
+        sys.exit("unknown mode %s, pick from %s" % (", ".join(sorted(unknown)), ", ".join(MODES)))
+
+    rows = []
+    for mode in args.modes or MODES:
+        idf(mode, "build")
+        times = frame_times(mode, args.port, args.seconds) if args.port else {}
+        rows.append((mode, dram_bytes(mode), times.get("draw"), times.get("flush")))
+
+    print("| mode | DRAM | vs %s | ui draw ms | bus flush ms |" % rows[0][0])
+    print("|---|---:|---:|---:|---:|")
+    for mode, dram, draw, flush in rows:
+        print("| %s | %d | %+d | %s | %s |" % (mode, dram, dram - rows[0][1], ms(draw), ms(flush)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,539 @@
+/**************************************
+ * Display simulator
+ * Runs the display component on a host against a simulated ssd1306, so screens can be
+ * checked and the display path measured without a board.
+ *
+ *   display_sim [-o DIR | -c DIR] [-n RUNS] [-r UPDATES] [-t] [-s]
+ *
+ *   -o DIR      write what the panel shows after each step below to DIR/<screen>-<update>.pbm
+ *   -c DIR      compare it with DIR/<screen>-<update>.pbm instead, the golden frames
+ *   -n RUNS     repeat each step RUNS times and print the mean time the call held the caller
+ *               and the bytes it put on the bus, 0 skips this (default 200)
+ *   -r UPDATES  then make UPDATES random ui updates, checked in bursts of 1 to 8
+ *   -t          send frames from display_render_task on a thread of its own, full frame only
+ *   -s          hold every transfer as long as it takes at 400 kHz, so with -t the ui gets
+ *               ahead of the bus and frames are dropped the way they are on the board
+ *
+ * Every step is an update the ui makes. After each step and each burst of random updates
+ * the panel must hold exactly what a full redraw of the same screen gives, which is what
+ * catches a partial redraw, tile diff, sparkline scroll or dropped frame that left stale or
+ * stray pixels behind. An update that changes nothing must put nothing on the bus, and the
+ * panel must be powered as last asked. Exits 1 if any check or golden comparison fails.
+ */
+#include "display.h"
+#include "widgets.h"
+#include "sim_panel.h"
+#include "sim_rtos.h"
+#include "esp_timer.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS 200
+#define I2C_HZ 400000 // the hal's bus clock
+#define I2C_BITS_PER_BYTE 9 // eight and the ack
+#define MAX_BURST 8 // random updates between two redraw checks
+#define MAX_REPORTS 10 // failures printed before the rest are only counted
+
+//same tables as the ui in main.c
+static const MenuItem actuator_items[] = {
+  {"Fan",  0},
+  {"Vent", 1},
+  {"Lamp", 2},
+  {"Exit", 3},
+};
+static const Menu actuator_menu = { actuator_items, 4 };
+static const MenuItem *fan = &actuator_items[0];
+
+static const MenuItem action_items[] = {
+  {"Mode",   0},
+  {"Toggle", 1},
+  {"Adjust", 2},
+  {"Exit",   3},
+};
+static const Menu action_menu = { action_items, 4 };
+
+static TaskHandle_t renderer = NULL; // with -t
+static int failures = 0;
+
+//wait for the render task to send everything the ui has finished, frames already went out inline without one
+static void settle(){
+  if(renderer != NULL){
+    sim_rtos_wait_idle(renderer);
+  }
+}
+
+static void fail(const char *format, ...){
+  if(failures++ < MAX_REPORTS){
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+  }
+}
+
+/**************************************
+ * Redraw check
+ * The screen on the panel is drawn again from scratch by switching to another screen and
+ * back with the same data, and the two frames must match pixel for pixel. The screen in
+ * between has to differ from both, or the panel is not being sent anything.
+ */
+
+typedef struct {
+  bool on_menu; // home is the screen switched to from the menu, the menu from any other
+  void (*draw)(void); // the screen as it is, switching to it draws it in full
+} Redraw;
+
+static void away_from(const Redraw *redraw);
+
+static void check_redraw(const Redraw *redraw, const char *what){
+  settle();
+  SimFrame before;
+  sim_panel_capture(&before);
+  away_from(redraw);
+  settle();
+  SimFrame away;
+  sim_panel_capture(&away);
+  redraw->draw();
+  settle();
+  SimFrame after;
+  sim_panel_capture(&after);
+  int x = 0;
+  int y = 0;
+  if(sim_panel_diff(&before, &away, &x, &y) == 0){
+    fail("%s: switching screens left the panel as it was\n", what); // frames are not reaching it
+  }
+  int differ = sim_panel_diff(&before, &after, &x, &y);
+  if(differ > 0){
+    fail("%s: %d pixels differ from a full redraw, the first at %d,%d\n", what, differ, x, y);
+  }
+}
+
+//the bus must stay quiet for an update that changes nothing on the screen
+static void check_quiet(const char *what){
+  settle();
+  SimBusStats stats;
+  sim_panel_stats(&stats);
+  if(stats.bytes > 0){
+    fail("%s: changed nothing but sent %u bytes\n", what, stats.bytes);
+  }
+}
+
+/**************************************
+ * Steps
+ * before leaves the display one update away from the step, so every run of a step
+ * measures the same work. redraw draws the screen the step leaves, again.
+ */
+
+typedef struct {
+  const char *screen;
+  const char *update;
+  void (*before)(void);
+  void (*step)(void);
+  void (*redraw)(void);
+  bool quiet; // changes nothing
+} Step;
+
+static int trend_sample = 0;
+
+//a slow swing inside and a colder, wider one outside, in tenths of a degree
+static void push_trend(){
+  int phase = trend_sample++ % 40;
+  int swing = phase < 20 ? phase : 40 - phase;
+  homeTrend(215 + swing, 120 + 3 * swing);
+}
+
+static void home(){
+  homeScreen("23", "14", "9:41");
+}
+
+static void home_next_minute(){
+  homeScreen("23", "14", "9:42");
+}
+
+static void home_trend(){
+  push_trend();
+  home();
+}
+
+static void menu_top(){
+  displayMenu(&actuator_menu, 0);
+}
+
+static void menu_second(){
+  displayMenu(&actuator_menu, 1);
+}
+
+static void adjust(){
+  displayAdjust(fan);
+}
+
+static void toggle_on(){
+  displayToggle(fan, true);
+}
+
+static void toggle_off(){
+  displayToggle(fan, false);
+}
+
+static void mode_auto(){
+  displayMode(fan, true);
+}
+
+static const Step steps[] = {
+  { "home",   "full",    menu_top,   home,             home },
+  { "home",   "none",    home,       home,             home, true },
+  { "home",   "time",    home,       home_next_minute, home_next_minute },
+  { "home",   "trend",   home,       home_trend,       home },
+  { "menu",   "full",    home,       menu_top,         menu_top },
+  { "menu",   "cursor",  menu_top,   menu_second,      menu_second },
+  { "adjust", "full",    menu_top,   adjust,           adjust },
+  { "toggle", "full",    menu_top,   toggle_on,        toggle_on },
+  { "toggle", "value",   toggle_on,  toggle_off,       toggle_off },
+  { "mode",   "full",    menu_top,   mode_auto,        mode_auto },
+};
+
+#define NUM_STEPS (sizeof(steps) / sizeof(steps[0]))
+
+static void away_from(const Redraw *redraw){
+  if(redraw->on_menu){
+    home();
+  }else{
+    menu_top();
+  }
+}
+
+//write the frame to dir, or compare it with the one there
+static void snapshot(const char *dir, bool compare, const Step *step){
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s-%s.pbm", dir, step->screen, step->update);
+  SimFrame frame;
+  sim_panel_capture(&frame);
+  SimFrame shown;
+  sim_panel_shown(&frame, &shown);
+  if(!compare){
+    if(!sim_panel_write_pbm(&shown, path)){
+      fprintf(stderr, "could not write %s: %s\n", path, strerror(errno));
+      exit(1);
+    }
+    return;
+  }
+  SimFrame golden;
+  if(!sim_panel_read_pbm(&golden, path)){
+    fail("%s: could not read it\n", path);
+    return;
+  }
+  int x = 0;
+  int y = 0;
+  int differ = sim_panel_diff(&golden, &shown, &x, &y);
+  if(differ > 0){
+    fail("%s: %d pixels differ, the first at %d,%d\n", path, differ, x, y);
+  }
+}
+
+static void run_steps(const char *dir, bool compare){
+  for(int i = 0; i < NUM_STEPS; i++){
+    const Step *step = &steps[i];
+    char what[64];
+    snprintf(what, sizeof(what), "%s-%s", step->screen, step->update);
+    step->before();
+    settle();
+    sim_panel_reset_stats();
+    step->step();
+    if(step->quiet){
+      check_quiet(what);
+    }
+    settle();
+    if(dir != NULL){
+      snapshot(dir, compare, step);
+    }
+    Redraw redraw = { strcmp(step->screen, "menu") == 0, step->redraw };
+    check_redraw(&redraw, what);
+  }
+}
+
+static void bench(const Step *step, int runs){
+  int64_t total_us = 0;
+  uint64_t bytes = 0;
+  uint64_t transfers = 0;
+  for(int i = 0; i < runs; i++){
+    step->before();
+    settle();
+    sim_panel_reset_stats();
+    int64_t start = esp_timer_get_time();
+    step->step();
+    total_us += esp_timer_get_time() - start;
+    settle(); // the render task's bytes count too
+    SimBusStats stats;
+    sim_panel_stats(&stats);
+    bytes += stats.bytes;
+    transfers += stats.transfers;
+  }
+  double mean_bytes = (double)bytes / runs;
+  printf("| %s | %s | %.1f | %.0f | %.1f | %.2f |\n", step->screen, step->update,
+         (double)total_us / runs, mean_bytes, (double)transfers / runs,
+         mean_bytes * I2C_BITS_PER_BYTE * 1000 / I2C_HZ);
+}
+
+/**************************************
+ * Random updates
+ * What the ui last asked each screen to show is kept here, so the screen on the panel can
+ * be drawn again and an update that changes nothing can be told apart.
+ */
+
+typedef enum {
+  SCREEN_HOME,
+  SCREEN_MENU,
+  SCREEN_ADJUST,
+  SCREEN_CHOICE, // toggle and mode
+} SimScreen;
+
+typedef struct {
+  SimScreen screen;
+  char inside[8];
+  char outside[8];
+  char time[8];
+  bool trend_pending; // a column was pushed that home has not shown yet
+  const Menu *menu;
+  int selected;
+  const MenuItem *item;
+  bool toggle; // the choice screen is toggle rather than mode
+  bool choice; // is_enabled or is_auto
+  bool on;
+} Model;
+
+static Model model;
+
+//xorshift, a fixed seed so a failing run can be repeated
+static uint32_t random_state = 1;
+
+static uint32_t next_random(uint32_t bound){
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state % bound;
+}
+
+static void draw_model(){
+  switch(model.screen){
+    case(SCREEN_HOME):
+      homeScreen(model.inside, model.outside, model.time);
+      break;
+    case(SCREEN_MENU):
+      displayMenu(model.menu, model.selected);
+      break;
+    case(SCREEN_ADJUST):
+      displayAdjust(model.item);
+      break;
+    case(SCREEN_CHOICE):
+      if(model.toggle){
+        displayToggle(model.item, model.choice);
+      }else{
+        displayMode(model.item, model.choice);
+      }
+      break;
+  }
+}
+
+//the value strings the ui formats, narrow and wide ones so widgets shrink and grow
+static void random_temperature(char *out, size_t len){
+  static const int temps[] = { 23, 24, 9, -5, -12, 100 };
+  snprintf(out, len, "%d", temps[next_random(6)]);
+}
+
+static const MenuItem *random_item(){
+  const Menu *menu = next_random(2) ? &actuator_menu : &action_menu;
+  return &menu->items[next_random(menu->len)];
+}
+
+//what the choice screen offers, the same text for toggle and mode would draw the same screen
+static const char *choice_next(const Model *m){
+  if(m->toggle){
+    return m->choice ? "OFF" : "ON";
+  }
+  return m->choice ? "MANU" : "AUTO";
+}
+
+//whether the screen in the model shows anything other than it did in last
+static bool changed(const Model *last){
+  if(model.screen != last->screen){
+    return true;
+  }
+  switch(model.screen){
+    case(SCREEN_HOME):
+      return strcmp(model.inside, last->inside) != 0 || strcmp(model.outside, last->outside) != 0 ||
+             strcmp(model.time, last->time) != 0;
+    case(SCREEN_MENU):
+      return model.menu != last->menu || model.selected != last->selected;
+    case(SCREEN_ADJUST):
+      return strcmp(model.item->name, last->item->name) != 0;
+    case(SCREEN_CHOICE):
+      return strcmp(model.item->name, last->item->name) != 0 || strcmp(choice_next(&model), choice_next(last)) != 0;
+  }
+  return true;
+}
+
+//one random update, returns false when it should change nothing on the screen
+static bool random_update(){
+  Model last = model;
+  switch(next_random(8)){
+    case(0):
+    case(1):
+      model.screen = SCREEN_HOME;
+      random_temperature(model.inside, sizeof(model.inside));
+      random_temperature(model.outside, sizeof(model.outside));
+      snprintf(model.time, sizeof(model.time), "%d:%02d", 9 + next_random(2) * 3, 41 + next_random(2));
+      break;
+    case(2):{
+      //now and then a reading is missing or far off the scale, which rescales the trend
+      int16_t inside = next_random(16) == 0 ? TREND_NONE : 150 + next_random(next_random(4) == 0 ? 400 : 20);
+      int16_t outside = next_random(8) == 0 ? TREND_NONE : 50 + next_random(300);
+      homeTrend(inside, outside);
+      model.trend_pending = true;
+      return true; // nothing is drawn until the next home screen
+    }
+    case(3):
+    case(4):
+      model.screen = SCREEN_MENU;
+      model.menu = next_random(2) ? &actuator_menu : &action_menu;
+      model.selected = next_random(model.menu->len);
+      break;
+    case(5):
+      model.screen = SCREEN_ADJUST;
+      model.item = random_item();
+      break;
+    case(6):
+      model.screen = SCREEN_CHOICE;
+      model.item = random_item();
+      model.toggle = next_random(2);
+      model.choice = next_random(2);
+      break;
+    case(7):
+      model.on = next_random(2);
+      display_power(model.on);
+      return true;
+  }
+  bool shows_trend = model.screen == SCREEN_HOME && model.trend_pending;
+  if(shows_trend){
+    model.trend_pending = false;
+  }
+  draw_model();
+  return shows_trend || changed(&last);
+}
+
+static void check_power(const char *what){
+  settle();
+  SimFrame frame;
+  sim_panel_capture(&frame);
+  if(frame.on != model.on){
+    fail("%s: the panel is %s, it was last turned %s\n", what, frame.on ? "on" : "off",
+         model.on ? "on" : "off");
+  }
+}
+
+static void run_random(int updates){
+  //start from the last step's screen, drawn from the model
+  model = (Model){ .screen = SCREEN_HOME, .inside = "23", .outside = "14", .time = "9:41",
+                   .menu = &actuator_menu, .item = fan, .on = true };
+  draw_model();
+  display_power(true);
+  int done = 0;
+  while(done < updates){
+    int burst = 1 + next_random(MAX_BURST);
+    //with a render task, half the bursts come back to back so it falls behind and drops
+    //frames, the bus can only be checked between updates that wait for it
+    bool paced = renderer == NULL || next_random(2);
+    char what[64];
+    snprintf(what, sizeof(what), "random update %d", done);
+    for(int i = 0; i < burst && done < updates; i++, done++){
+      if(paced){
+        settle();
+        sim_panel_reset_stats();
+      }
+      if(!random_update() && paced){
+        check_quiet(what);
+      }
+    }
+    check_power(what);
+    if(model.screen == SCREEN_HOME && model.trend_pending){
+      draw_model(); // show the column first, or only the redraw would
+    }
+    Redraw redraw = { model.screen == SCREEN_MENU, draw_model };
+    check_redraw(&redraw, what);
+    model.trend_pending = false; // home was drawn either way
+  }
+  display_power(true);
+  model.on = true;
+}
+
+int main(int argc, char **argv){
+  const char *dir = NULL;
+  bool compare = false;
+  int runs = DEFAULT_RUNS;
+  int updates = 0;
+  bool threaded = false;
+  int opt;
+  while((opt = getopt(argc, argv, "o:c:n:r:ts")) != -1){
+    switch(opt){
+      case('o'):
+      case('c'):
+        dir = optarg;
+        compare = opt == 'c';
+        break;
+      case('n'):
+        runs = atoi(optarg);
+        break;
+      case('r'):
+        updates = atoi(optarg);
+        break;
+      case('t'):
+        threaded = true;
+        break;
+      case('s'):
+        sim_panel_slow_bus(true);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-o DIR | -c DIR] [-n RUNS] [-r UPDATES] [-t] [-s]\n", argv[0]);
+        return 2;
+    }
+  }
+  if(dir != NULL && !compare && mkdir(dir, 0755) != 0 && errno != EEXIST){
+    fprintf(stderr, "could not create %s: %s\n", dir, strerror(errno));
+    return 1;
+  }
+
+  display_init();
+  if(threaded){
+#if CONFIG_DISPLAY_BUFFER_FULL
+    renderer = sim_rtos_start(display_render_task, NULL);
+#else
+    fprintf(stderr, "-t needs the full frame buffer, page modes have no render task\n");
+    return 2;
+#endif
+  }
+  for(int i = 0; i < SPARKLINE_COLS; i++){
+    push_trend(); // a full history, as after a while in use
+  }
+
+  run_steps(dir, compare);
+  if(updates > 0){
+    run_random(updates);
+  }
+
+  if(runs > 0){
+    printf("| screen | update | render us | bus bytes | transfers | bus ms at %d kHz |\n", I2C_HZ / 1000);
+    printf("|---|---|---:|---:|---:|---:|\n");
+    for(int i = 0; i < NUM_STEPS; i++){
+      bench(&steps[i], runs);
+    }
+  }
+  if(failures > 0){
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1 @@
+//nothing from the gpio driver is used by the display, the simulated panel has no pins
@@ -0,0 +1 @@
+//the bus is the simulated panel in sim_panel.c
@@ -0,0 +1,7 @@
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+#include <stdint.h>
+#include <pthread.h>
+
+//critical sections are a mutex, so the render task can run as a thread of its own (-t)
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+
+#define pdTRUE 1
+#define portMAX_DELAY UINT32_MAX
+
+#endif
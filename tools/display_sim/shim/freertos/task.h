@@ -0,0 +1,13 @@
+#ifndef TASK_H
+#define TASK_H
+#include <stddef.h>
+#include <stdint.h>
+
+//task notifications between threads, see sim_rtos.c
+typedef struct SimTask *TaskHandle_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(int clear, uint32_t wait); // only portMAX_DELAY is supported
+
+#endif
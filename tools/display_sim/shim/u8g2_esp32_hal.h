@@ -0,0 +1,22 @@
+#ifndef U8G2_ESP32_HAL_H
+#define U8G2_ESP32_HAL_H
+#include <stdint.h>
+#include "u8g2.h"
+
+//same names as the esp-idf hal, the callbacks drive the simulated panel instead of the i2c bus
+typedef struct {
+  struct {
+    struct {
+      uint8_t sda;
+      uint8_t scl;
+    } i2c;
+  } bus;
+} u8g2_esp32_hal_t;
+
+#define U8G2_ESP32_HAL_DEFAULT { 0 }
+
+void u8g2_esp32_hal_init(u8g2_esp32_hal_t hal);
+uint8_t u8g2_esp32_i2c_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+uint8_t u8g2_esp32_gpio_and_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+
+#endif
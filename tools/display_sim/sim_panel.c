@@ -0,0 +1,206 @@
+#include "sim_panel.h"
+#include "u8g2_esp32_hal.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define CONTROL_DATA 0x40 // first byte of a transfer, 0x00 starts commands instead
+#define BUS_NS_PER_BYTE 22500 // nine bits at 400 kHz
+
+static uint8_t ram[SIM_PANEL_PAGES][SIM_PANEL_WIDTH];
+static bool display_on = false;
+static int page = 0;
+static int column = 0;
+
+static SimBusStats stats;
+static bool slow_bus = false;
+static uint32_t transfer_bytes = 0;
+
+//where the bytes of the current transfer go
+typedef enum {
+  EXPECT_CONTROL,
+  COMMANDS,
+  DATA,
+} TransferState;
+
+static TransferState state = EXPECT_CONTROL;
+static int args_left = 0; // of the last multi byte command, skipped
+
+//bytes that follow a command, for the commands u8g2's ssd1306 init sequence and drivers send
+static int command_args(uint8_t cmd){
+  switch(cmd){
+    case(0x20): case(0x81): case(0x8d): case(0xa8): case(0xd3):
+    case(0xd5): case(0xd9): case(0xda): case(0xdb):
+      return 1;
+    case(0x21): case(0x22): case(0xa3):
+      return 2;
+    case(0x29): case(0x2a):
+      return 5;
+    case(0x26): case(0x27):
+      return 6;
+    default:
+      return 0;
+  }
+}
+
+//only page addressing is modelled, which is all u8g2 uses to place tiles
+static void command(uint8_t cmd){
+  if(args_left > 0){
+    args_left--;
+  }else if(cmd <= 0x0f){
+    column = (column & 0xf0) | cmd;
+  }else if(cmd <= 0x1f){
+    column = ((cmd & 0x0f) << 4) | (column & 0x0f);
+  }else if(cmd >= 0xb0 && cmd <= 0xb7){
+    page = cmd & 0x07;
+  }else if(cmd == 0xae || cmd == 0xaf){
+    display_on = cmd == 0xaf;
+  }else{
+    args_left = command_args(cmd);
+  }
+}
+
+static void data(uint8_t byte){
+  ram[page][column] = byte;
+  column = (column + 1) % SIM_PANEL_WIDTH; // page addressing wraps within the page
+}
+
+static void receive(const uint8_t *bytes, int len){
+  stats.bytes += len;
+  transfer_bytes += len;
+  for(int i = 0; i < len; i++){
+    switch(state){
+      case(EXPECT_CONTROL):
+        state = bytes[i] == CONTROL_DATA ? DATA : COMMANDS;
+        break;
+      case(COMMANDS):
+        command(bytes[i]);
+        break;
+      case(DATA):
+        data(bytes[i]);
+        break;
+    }
+  }
+}
+
+void u8g2_esp32_hal_init(u8g2_esp32_hal_t hal){
+  memset(ram, 0, sizeof(ram));
+  display_on = false;
+}
+
+uint8_t u8g2_esp32_i2c_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr){
+  switch(msg){
+    case(U8X8_MSG_BYTE_START_TRANSFER):
+      stats.transfers++;
+      stats.bytes++; // address byte
+      transfer_bytes = 1;
+      state = EXPECT_CONTROL;
+      args_left = 0;
+      break;
+    case(U8X8_MSG_BYTE_END_TRANSFER):
+      if(slow_bus){
+        uint64_t ns = (uint64_t)transfer_bytes * BUS_NS_PER_BYTE;
+        struct timespec hold = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+        nanosleep(&hold, NULL);
+      }
+      break;
+    case(U8X8_MSG_BYTE_SEND):
+      receive(arg_ptr, arg_int);
+      break;
+    default:
+      break;
+  }
+  return 1;
+}
+
+//no pins to drive and no reason to wait
+uint8_t u8g2_esp32_gpio_and_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr){
+  return 1;
+}
+
+void sim_panel_stats(SimBusStats *out){
+  *out = stats;
+}
+
+void sim_panel_reset_stats(void){
+  memset(&stats, 0, sizeof(stats));
+}
+
+void sim_panel_slow_bus(bool slow){
+  slow_bus = slow;
+}
+
+void sim_panel_capture(SimFrame *frame){
+  memcpy(frame->ram, ram, sizeof(ram));
+  frame->on = display_on;
+}
+
+int sim_panel_diff(const SimFrame *a, const SimFrame *b, int *x, int *y){
+  int differ = 0;
+  for(int row = SIM_PANEL_PAGES * 8 - 1; row >= 0; row--){
+    for(int col = SIM_PANEL_WIDTH - 1; col >= 0; col--){
+      int bit_a = (a->ram[row / 8][col] >> (row % 8)) & 1;
+      int bit_b = (b->ram[row / 8][col] >> (row % 8)) & 1;
+      if(bit_a != bit_b){
+        differ++;
+        *x = col; // scanning backwards leaves the first one
+        *y = row;
+      }
+    }
+  }
+  return differ;
+}
+
+void sim_panel_shown(const SimFrame *frame, SimFrame *shown){
+  if(frame->on){
+    *shown = *frame;
+  }else{
+    memset(shown, 0, sizeof(*shown));
+  }
+  shown->on = true;
+}
+
+//binary pbm, rows of pixels packed 8 to a byte with the leftmost in the high bit, 1 is black
+bool sim_panel_write_pbm(const SimFrame *frame, const char *path){
+  SimFrame shown;
+  sim_panel_shown(frame, &shown);
+  FILE *f = fopen(path, "wb");
+  if(f == NULL){
+    return false;
+  }
+  fprintf(f, "P4\n%d %d\n", SIM_PANEL_WIDTH, SIM_PANEL_PAGES * 8);
+  for(int y = 0; y < SIM_PANEL_PAGES * 8; y++){
+    uint8_t row[SIM_PANEL_WIDTH / 8] = {0};
+    for(int x = 0; x < SIM_PANEL_WIDTH; x++){
+      bool lit = (shown.ram[y / 8][x] >> (y % 8)) & 1;
+      row[x / 8] |= lit << (7 - x % 8);
+    }
+    fwrite(row, 1, sizeof(row), f);
+  }
+  return fclose(f) == 0;
+}
+
+//only reads what sim_panel_write_pbm writes, a 128x64 P4 with a plain header
+bool sim_panel_read_pbm(SimFrame *frame, const char *path){
+  FILE *f = fopen(path, "rb");
+  if(f == NULL){
+    return false;
+  }
+  int width = 0;
+  int height = 0;
+  bool ok = fscanf(f, "P4 %d %d", &width, &height) == 2 && fgetc(f) == '\n' &&
+            width == SIM_PANEL_WIDTH && height == SIM_PANEL_PAGES * 8;
+  memset(frame, 0, sizeof(*frame));
+  frame->on = true;
+  for(int y = 0; ok && y < height; y++){
+    uint8_t row[SIM_PANEL_WIDTH / 8];
+    ok = fread(row, 1, sizeof(row), f) == sizeof(row);
+    for(int x = 0; ok && x < width; x++){
+      if((row[x / 8] >> (7 - x % 8)) & 1){
+        frame->ram[y / 8][x] |= 1 << (y % 8);
+      }
+    }
+  }
+  fclose(f);
+  return ok;
+}
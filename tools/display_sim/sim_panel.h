@@ -0,0 +1,41 @@
+#ifndef SIM_PANEL_H
+#define SIM_PANEL_H
+#include <stdbool.h>
+#include <stdint.h>
+
+//an ssd1306 on the other end of the u8g2 byte callback, it keeps the panel ram the
+//commands and data build up and counts what crossed the bus
+
+#define SIM_PANEL_WIDTH 128
+#define SIM_PANEL_PAGES 8 // 8 pixel rows per page, top pixel in bit 0
+
+typedef struct {
+  uint32_t bytes; // on the wire, address and control bytes included
+  uint32_t transfers; // i2c start conditions
+} SimBusStats;
+
+//what the panel holds, its ram keeps the last frame while the display is in power save
+typedef struct {
+  uint8_t ram[SIM_PANEL_PAGES][SIM_PANEL_WIDTH];
+  bool on;
+} SimFrame;
+
+void sim_panel_stats(SimBusStats *stats);
+void sim_panel_reset_stats(void);
+
+//hold every transfer for as long as it takes on a 400 kHz bus, so a render task falls
+//behind the frames the ui draws the way it does on the board
+void sim_panel_slow_bus(bool slow);
+
+void sim_panel_capture(SimFrame *frame);
+
+//pixels of panel ram that differ, the first one in x and y when there is one, power is not compared
+int sim_panel_diff(const SimFrame *a, const SimFrame *b, int *x, int *y);
+
+//what the panel shows as a binary pbm, a blank screen while it is in power save
+//a frame read back from one is all ram and no power state, so only compare shown frames with it
+bool sim_panel_write_pbm(const SimFrame *frame, const char *path);
+bool sim_panel_read_pbm(SimFrame *frame, const char *path);
+void sim_panel_shown(const SimFrame *frame, SimFrame *shown); // blanked when off, on either way
+
+#endif
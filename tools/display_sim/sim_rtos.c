@@ -0,0 +1,84 @@
+#include "sim_rtos.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+//one per thread, created the first time the thread asks for its handle
+struct SimTask {
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // a notification arrived or the task started waiting
+  uint32_t notified;
+  bool waiting;
+  void (*entry)(void *);
+  void *parameters;
+};
+
+static __thread struct SimTask *current = NULL;
+
+static struct SimTask *new_task(void){
+  struct SimTask *task = calloc(1, sizeof(*task));
+  pthread_mutex_init(&task->lock, NULL);
+  pthread_cond_init(&task->changed, NULL);
+  return task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void){
+  if(current == NULL){
+    current = new_task();
+  }
+  return current;
+}
+
+void xTaskNotifyGive(TaskHandle_t task){
+  pthread_mutex_lock(&task->lock);
+  task->notified++;
+  pthread_cond_broadcast(&task->changed);
+  pthread_mutex_unlock(&task->lock);
+}
+
+uint32_t ulTaskNotifyTake(int clear, uint32_t wait){
+  if(wait != portMAX_DELAY){
+    fprintf(stderr, "ulTaskNotifyTake: only portMAX_DELAY is simulated\n");
+    abort();
+  }
+  struct SimTask *task = xTaskGetCurrentTaskHandle();
+  pthread_mutex_lock(&task->lock);
+  while(task->notified == 0){
+    task->waiting = true;
+    pthread_cond_broadcast(&task->changed);
+    pthread_cond_wait(&task->changed, &task->lock);
+  }
+  task->waiting = false;
+  uint32_t value = task->notified;
+  task->notified = clear ? 0 : value - 1;
+  pthread_mutex_unlock(&task->lock);
+  return value;
+}
+
+static void *run(void *arg){
+  current = arg;
+  current->entry(current->parameters);
+  return NULL;
+}
+
+TaskHandle_t sim_rtos_start(void (*entry)(void *), void *parameters){
+  struct SimTask *task = new_task();
+  task->entry = entry;
+  task->parameters = parameters;
+  pthread_t thread;
+  if(pthread_create(&thread, NULL, run, task) != 0){
+    perror("pthread_create");
+    exit(1);
+  }
+  pthread_detach(thread);
+  return task;
+}
+
+void sim_rtos_wait_idle(TaskHandle_t task){
+  pthread_mutex_lock(&task->lock);
+  while(!task->waiting || task->notified > 0){
+    pthread_cond_wait(&task->changed, &task->lock);
+  }
+  pthread_mutex_unlock(&task->lock);
+}
@@ -0,0 +1,11 @@
+#ifndef SIM_RTOS_H
+#define SIM_RTOS_H
+#include "freertos/task.h"
+
+//run a task function on a thread of its own, it never returns so neither does the thread
+TaskHandle_t sim_rtos_start(void (*task)(void *), void *parameters);
+
+//block until the task is waiting for a notification and none is pending
+void sim_rtos_wait_idle(TaskHandle_t task);
+
+#endif
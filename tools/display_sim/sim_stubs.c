@@ -0,0 +1,23 @@
+#include "metrics.h"
+#include "power_mgmt.h"
+#include "esp_timer.h"
+#include <time.h>
+
+//the display records into these, display_sim.c times frames itself
+uint32_t metric_counters[METRIC_NUM_COUNTERS];
+int32_t metric_gauges[METRIC_NUM_GAUGES];
+MetricHistogramData metric_histograms[METRIC_NUM_HISTOGRAMS];
+
+void metric_observe(MetricHistogram id, uint32_t duration_us){
+  metric_histograms[id].count++;
+  metric_histograms[id].sum_us += duration_us;
+}
+
+void power_mgmt_acquire(PmDomain domain){}
+void power_mgmt_release(PmDomain domain){}
+
+int64_t esp_timer_get_time(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
@@ -0,0 +1,83 @@
+#ifndef U8G2_H
+#define U8G2_H
+#include <stdint.h>
+
+/**************************************
+ * Stand in u8g2
+ * The part of the u8g2 api the display component uses, for host builds without the
+ * submodule. Frames reach the panel over the same byte callback with the same ssd1306
+ * commands, so bus figures are comparable. The font is not: every glyph is a fixed dot
+ * pattern one column wider on each side than its advance, which makes text that spills
+ * out of its widget easy to spot in the snapshots.
+ */
+
+typedef uint8_t u8g2_uint_t; // coordinates, as in the real library for a 128x64 panel
+
+typedef struct u8x8_struct u8x8_t;
+typedef uint8_t (*u8x8_msg_cb)(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+
+struct u8x8_struct {
+  u8x8_msg_cb byte_cb;
+};
+
+typedef struct u8g2_cb_struct u8g2_cb_t;
+extern const u8g2_cb_t *U8G2_R0;
+
+//byte callback messages, same values as u8x8.h
+#define U8X8_MSG_BYTE_SEND 23
+#define U8X8_MSG_BYTE_START_TRANSFER 24
+#define U8X8_MSG_BYTE_END_TRANSFER 25
+#define U8X8_MSG_BYTE_SET_DC 32
+#define U8X8_MSG_BYTE_INIT 40
+
+typedef struct {
+  u8x8_t u8x8;
+  uint8_t *tile_buf_ptr;
+  uint8_t tile_buf_height; // pages of 8 rows the buffer holds
+  uint8_t tile_curr_row; // first page of the screen the buffer holds
+  uint8_t draw_color; // 0 clears, 1 sets, 2 inverts
+  u8g2_uint_t clip_x0; // clip window, x1 and y1 excluded
+  u8g2_uint_t clip_y0;
+  u8g2_uint_t clip_x1;
+  u8g2_uint_t clip_y1;
+  u8g2_uint_t user_x0; // clip window and buffer window intersected, where drawing lands
+  u8g2_uint_t user_y0;
+  u8g2_uint_t user_x1;
+  u8g2_uint_t user_y1;
+} u8g2_t;
+
+void u8g2_Setup_ssd1306_i2c_128x64_noname_f(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+void u8g2_Setup_ssd1306_i2c_128x64_noname_2(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+void u8g2_Setup_ssd1306_i2c_128x64_noname_1(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+void u8x8_SetI2CAddress(u8x8_t *u8x8, uint8_t address);
+void u8g2_InitDisplay(u8g2_t *u8g2);
+void u8g2_SetPowerSave(u8g2_t *u8g2, uint8_t is_enable);
+
+uint8_t *u8g2_GetBufferPtr(u8g2_t *u8g2);
+uint8_t u8g2_GetBufferTileWidth(u8g2_t *u8g2);
+uint8_t u8g2_GetBufferTileHeight(u8g2_t *u8g2);
+void u8g2_SetBufferCurrTileRow(u8g2_t *u8g2, uint8_t row);
+void u8g2_ClearBuffer(u8g2_t *u8g2);
+void u8g2_SendBuffer(u8g2_t *u8g2);
+void u8g2_UpdateDisplayArea(u8g2_t *u8g2, uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th);
+void u8g2_FirstPage(u8g2_t *u8g2);
+uint8_t u8g2_NextPage(u8g2_t *u8g2);
+
+void u8g2_SetClipWindow(u8g2_t *u8g2, u8g2_uint_t clip_x0, u8g2_uint_t clip_y0, u8g2_uint_t clip_x1, u8g2_uint_t clip_y1);
+void u8g2_SetMaxClipWindow(u8g2_t *u8g2);
+void u8g2_SetDrawColor(u8g2_t *u8g2, uint8_t color);
+
+extern const uint8_t u8g2_font_tenthinguys_t_all[];
+void u8g2_SetFont(u8g2_t *u8g2, const uint8_t *font);
+int8_t u8g2_GetAscent(u8g2_t *u8g2);
+int8_t u8g2_GetDescent(u8g2_t *u8g2);
+u8g2_uint_t u8g2_DrawGlyph(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, uint16_t encoding);
+u8g2_uint_t u8g2_DrawStr(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, const char *str);
+
+void u8g2_DrawPixel(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y);
+void u8g2_DrawVLine(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t h);
+void u8g2_DrawBox(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h);
+void u8g2_DrawRFrame(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, u8g2_uint_t r);
+void u8g2_DrawTriangle(u8g2_t *u8g2, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2);
+
+#endif
@@ -0,0 +1,264 @@
+#include "u8g2.h"
+#include <string.h>
+
+#define WIDTH 128
+#define PAGES 8
+#define TILE_WIDTH (WIDTH / 8)
+#define DATA_CHUNK 24 // data bytes per transfer, u8g2's ssd1306 i2c driver sends tiles in threes
+
+const u8g2_cb_t *U8G2_R0 = NULL;
+const uint8_t u8g2_font_tenthinguys_t_all[1];
+
+//like the real setup functions, every panel gets the static buffer of its own size
+//the display component sets up a full buffer twice, once to draw and once to send
+static uint8_t full_buffers[2][PAGES * WIDTH];
+static int full_buffers_used = 0;
+static uint8_t page_buffer[2 * WIDTH];
+
+/**************************************
+ * Bus
+ */
+
+static void start_transfer(u8g2_t *u8g2){
+  u8g2->u8x8.byte_cb(&u8g2->u8x8, U8X8_MSG_BYTE_START_TRANSFER, 0, NULL);
+}
+
+static void end_transfer(u8g2_t *u8g2){
+  u8g2->u8x8.byte_cb(&u8g2->u8x8, U8X8_MSG_BYTE_END_TRANSFER, 0, NULL);
+}
+
+static void send_bytes(u8g2_t *u8g2, const uint8_t *bytes, int len){
+  u8g2->u8x8.byte_cb(&u8g2->u8x8, U8X8_MSG_BYTE_SEND, len, (void *)bytes);
+}
+
+static void send_commands(u8g2_t *u8g2, const uint8_t *cmds, int len){
+  static const uint8_t control = 0x00;
+  start_transfer(u8g2);
+  send_bytes(u8g2, &control, 1);
+  send_bytes(u8g2, cmds, len);
+  end_transfer(u8g2);
+}
+
+//one row of tiles, addressed with the page addressing commands
+static void send_tiles(u8g2_t *u8g2, int tx, int page, int tw, const uint8_t *src){
+  static const uint8_t control = 0x40;
+  int x = tx * 8;
+  const uint8_t position[] = {0x10 | (x >> 4), x & 0x0f, 0xb0 | page};
+  send_commands(u8g2, position, sizeof(position));
+  for(int sent = 0; sent < tw * 8; sent += DATA_CHUNK){
+    int len = tw * 8 - sent < DATA_CHUNK ? tw * 8 - sent : DATA_CHUNK;
+    start_transfer(u8g2);
+    send_bytes(u8g2, &control, 1);
+    send_bytes(u8g2, src + sent, len);
+    end_transfer(u8g2);
+  }
+}
+
+/**************************************
+ * Setup and buffer
+ */
+
+//where drawing lands, the clip window cut down to the rows the buffer holds
+static void update_page_window(u8g2_t *u8g2){
+  int buf_y0 = u8g2->tile_curr_row * 8;
+  int buf_y1 = buf_y0 + u8g2->tile_buf_height * 8;
+  u8g2->user_x0 = u8g2->clip_x0;
+  u8g2->user_x1 = u8g2->clip_x1;
+  u8g2->user_y0 = u8g2->clip_y0 > buf_y0 ? u8g2->clip_y0 : buf_y0;
+  u8g2->user_y1 = u8g2->clip_y1 < buf_y1 ? u8g2->clip_y1 : buf_y1;
+  if(u8g2->user_y1 < u8g2->user_y0){
+    u8g2->user_y1 = u8g2->user_y0;
+  }
+}
+
+static void setup(u8g2_t *u8g2, u8x8_msg_cb byte_cb, int pages){
+  memset(u8g2, 0, sizeof(*u8g2));
+  u8g2->u8x8.byte_cb = byte_cb;
+  u8g2->tile_buf_height = pages;
+  u8g2->tile_buf_ptr = pages == PAGES ? full_buffers[full_buffers_used++] : page_buffer;
+  u8g2->draw_color = 1;
+  u8g2_SetMaxClipWindow(u8g2);
+}
+
+void u8g2_Setup_ssd1306_i2c_128x64_noname_f(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb){
+  setup(u8g2, byte_cb, PAGES);
+}
+
+void u8g2_Setup_ssd1306_i2c_128x64_noname_2(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb){
+  setup(u8g2, byte_cb, 2);
+}
+
+void u8g2_Setup_ssd1306_i2c_128x64_noname_1(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb){
+  setup(u8g2, byte_cb, 1);
+}
+
+void u8x8_SetI2CAddress(u8x8_t *u8x8, uint8_t address){}
+
+//an ssd1306 init sequence for a 128x64 panel, left in power save
+void u8g2_InitDisplay(u8g2_t *u8g2){
+  static const uint8_t init[] = {
+    0xae, 0xd5, 0x80, 0xa8, 0x3f, 0xd3, 0x00, 0x40, 0x8d, 0x14, 0x20, 0x00,
+    0xa1, 0xc8, 0xda, 0x12, 0x81, 0xcf, 0xd9, 0xf1, 0xdb, 0x40, 0x2e, 0xa4, 0xa6,
+  };
+  send_commands(u8g2, init, sizeof(init));
+}
+
+void u8g2_SetPowerSave(u8g2_t *u8g2, uint8_t is_enable){
+  uint8_t cmd = is_enable ? 0xae : 0xaf;
+  send_commands(u8g2, &cmd, 1);
+}
+
+uint8_t *u8g2_GetBufferPtr(u8g2_t *u8g2){
+  return u8g2->tile_buf_ptr;
+}
+
+uint8_t u8g2_GetBufferTileWidth(u8g2_t *u8g2){
+  return TILE_WIDTH;
+}
+
+uint8_t u8g2_GetBufferTileHeight(u8g2_t *u8g2){
+  return u8g2->tile_buf_height;
+}
+
+void u8g2_SetBufferCurrTileRow(u8g2_t *u8g2, uint8_t row){
+  u8g2->tile_curr_row = row;
+  update_page_window(u8g2);
+}
+
+void u8g2_ClearBuffer(u8g2_t *u8g2){
+  memset(u8g2->tile_buf_ptr, 0, u8g2->tile_buf_height * WIDTH);
+}
+
+void u8g2_SendBuffer(u8g2_t *u8g2){
+  for(int page = 0; page < u8g2->tile_buf_height; page++){
+    send_tiles(u8g2, 0, u8g2->tile_curr_row + page, TILE_WIDTH, &u8g2->tile_buf_ptr[page * WIDTH]);
+  }
+}
+
+void u8g2_UpdateDisplayArea(u8g2_t *u8g2, uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th){
+  for(int page = ty; page < ty + th; page++){
+    send_tiles(u8g2, tx, page, tw, &u8g2->tile_buf_ptr[page * WIDTH + tx * 8]);
+  }
+}
+
+void u8g2_FirstPage(u8g2_t *u8g2){
+  u8g2_SetBufferCurrTileRow(u8g2, 0);
+  u8g2_ClearBuffer(u8g2);
+}
+
+uint8_t u8g2_NextPage(u8g2_t *u8g2){
+  u8g2_SendBuffer(u8g2);
+  int next = u8g2->tile_curr_row + u8g2->tile_buf_height;
+  if(next >= PAGES){
+    u8g2_SetBufferCurrTileRow(u8g2, 0);
+    return 0;
+  }
+  u8g2_SetBufferCurrTileRow(u8g2, next);
+  u8g2_ClearBuffer(u8g2);
+  return 1;
+}
+
+/**************************************
+ * Drawing
+ */
+
+void u8g2_SetClipWindow(u8g2_t *u8g2, u8g2_uint_t clip_x0, u8g2_uint_t clip_y0, u8g2_uint_t clip_x1, u8g2_uint_t clip_y1){
+  u8g2->clip_x0 = clip_x0;
+  u8g2->clip_y0 = clip_y0;
+  u8g2->clip_x1 = clip_x1;
+  u8g2->clip_y1 = clip_y1;
+  update_page_window(u8g2);
+}
+
+void u8g2_SetMaxClipWindow(u8g2_t *u8g2){
+  u8g2_SetClipWindow(u8g2, 0, 0, WIDTH, PAGES * 8);
+}
+
+void u8g2_SetDrawColor(u8g2_t *u8g2, uint8_t color){
+  u8g2->draw_color = color;
+}
+
+//every drawing call ends up here, anything outside the user window is dropped
+static void pixel(u8g2_t *u8g2, int x, int y){
+  if(x < u8g2->user_x0 || x >= u8g2->user_x1 || y < u8g2->user_y0 || y >= u8g2->user_y1){
+    return;
+  }
+  int row = y - u8g2->tile_curr_row * 8;
+  uint8_t *byte = &u8g2->tile_buf_ptr[(row / 8) * WIDTH + x];
+  uint8_t mask = 1 << (row % 8);
+  if(u8g2->draw_color == 2){
+    *byte ^= mask;
+  }else if(u8g2->draw_color == 1){
+    *byte |= mask;
+  }else{
+    *byte &= ~mask;
+  }
+}
+
+void u8g2_SetFont(u8g2_t *u8g2, const uint8_t *font){}
+
+int8_t u8g2_GetAscent(u8g2_t *u8g2){
+  return 10;
+}
+
+int8_t u8g2_GetDescent(u8g2_t *u8g2){
+  return -3;
+}
+
+//a dot pattern that depends on the character, inked from one column left of x to one past the advance
+u8g2_uint_t u8g2_DrawGlyph(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, uint16_t encoding){
+  int width = 4 + encoding % 4;
+  for(int col = -1; col <= width; col++){
+    for(int row = -10; row <= 2; row++){
+      if((encoding * 31 + col * 7 + row * 13) % 5 < 2){
+        pixel(u8g2, x + col, y + row);
+      }
+    }
+  }
+  return width + 1;
+}
+
+u8g2_uint_t u8g2_DrawStr(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, const char *str){
+  int advance = 0;
+  for(const char *c = str; *c != '\0'; c++){
+    advance += u8g2_DrawGlyph(u8g2, x + advance, y, (uint8_t)*c);
+  }
+  return advance;
+}
+
+void u8g2_DrawPixel(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y){
+  pixel(u8g2, x, y);
+}
+
+void u8g2_DrawBox(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h){
+  for(int col = x; col < x + w; col++){
+    for(int row = y; row < y + h; row++){
+      pixel(u8g2, col, row);
+    }
+  }
+}
+
+void u8g2_DrawVLine(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t h){
+  u8g2_DrawBox(u8g2, x, y, 1, h);
+}
+
+//square corners, the radius only matters to the look
+void u8g2_DrawRFrame(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, u8g2_uint_t r){
+  for(int col = x; col < x + w; col++){
+    pixel(u8g2, col, y);
+    pixel(u8g2, col, y + h - 1);
+  }
+  for(int row = y + 1; row < y + h - 1; row++){
+    pixel(u8g2, x, row);
+    pixel(u8g2, x + w - 1, row);
+  }
+}
+
+//filled as its bounding box, for the one right pointing triangle the list cursor is
+void u8g2_DrawTriangle(u8g2_t *u8g2, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2){
+  for(int col = x0; col <= x2; col++){
+    for(int row = y0; row <= y1; row++){
+      pixel(u8g2, col, row);
+    }
+  }
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""Build every DeskAssist build profile and report its flash, RAM and boot time.
+
+Run from the project root inside an ESP-IDF environment:
+
+    tools/profile_report.py
+    tools/profile_report.py --port /dev/ttyUSB0
+
+Each profile is built into build/profile-<name> from sdkconfig.defaults plus
+sdkconfig.<name>. Flash is the size of the app image and DRAM / IRAM come from
+idf.py size. With --port every profile is also flashed and the boot timeline it
+prints is read back for the time to first frame and first control.
+"""
+import argparse
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+PROFILES = ["offline", "networked", "telemetry"]
+BOOT_STAGES = {"first_frame": "Time to first frame", "first_control": "Time to first control"}
+BOOT_TIMEOUT_S = 30
+
+
+def build_dir(profile):
+    return os.path.join("build", "profile-" + profile)
+
+
+def idf(profile, *args, capture=False):
+    out = build_dir(profile)
+    cmd = ["idf.py", "-B", out,
+           "-D", "SDKCONFIG=" + os.path.join(out, "sdkconfig"),
+           "-D", "SDKCONFIG_DEFAULTS=sdkconfig.defaults;sdkconfig." + profile] + list(args)
+    result = subprocess.run(cmd, check=True, stdout=subprocess.PIPE if capture else None,
+                            universal_newlines=True)
+    return result.stdout
+
+
+def app_image_bytes(profile):
+    # the app image is the only .bin at the top of the build directory
+    images = glob.glob(os.path.join(build_dir(profile), "*.bin"))
+    if len(images) != 1:
+        sys.exit("expected one app image in %s, found %d" % (build_dir(profile), len(images)))
+    return os.path.getsize(images[0])
+
+
+def size_json(profile, fmt):
+    # idf.py prints its own progress lines ahead of the report
+    text = idf(profile, "size", "--format", fmt, capture=True)
+    return json.loads(text[text.index("{"):])
+
+
+def ram_bytes(profile):
+    """DRAM and IRAM in use, from either esp-idf-size json2 or the older idf_size json."""
+    try:
+        size = size_json(profile, "json2")
+        used = {region["name"]: region["used"] for region in size["layout"]}
+        return used.get("DRAM", 0), used.get("IRAM", 0)
+    except (subprocess.CalledProcessError, ValueError, KeyError):
+        size = size_json(profile, "json")
+        return size["used_dram"], size["used_iram"]
+
+
+def boot_times(profile, port):
+    """Flash the profile, reset the board and read the boot timeline summary."""
+    import serial  # part of the esp-idf python environment
+
+    idf(profile, "-p", port, "flash")
+    found = {}
+    with serial.Serial(port, 115200, timeout=1) as console:
+        # same reset sequence as idf.py monitor
+        console.dtr = False
+        console.rts = True
+        time.sleep(0.1)
+        console.rts = False
+        deadline = time.time() + BOOT_TIMEOUT_S
+        while len(found) < len(BOOT_STAGES) and time.time() < deadline:
+            line = console.readline().decode(errors="replace")
+            for key, label in BOOT_STAGES.items():
+                match = re.search(label + r": (-?\d+) us", line)
+                if match:
+                    found[key] = int(match.group(1))
+    return found
+
+
+def ms(us):
+    return "-" if us is None or us < 0 else "%.1f" % (us / 1000)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-p", "--port", help="serial port of a board to measure boot times on")
+    parser.add_argument("profiles", nargs="*", help="profiles to report, all of them by default")
+    args = parser.parse_args()
+    unknown = set(args.profiles) - set(PROFILES)
+    if unknown:
+        sys.exit("unknown profile %s, pick from %s" % (", ".join(sorted(unknown)), ", ".join(PROFILES)))
+
+    rows = []
+    for profile in args.profiles or PROFILES:
+        idf(profile, "build")
+        dram, iram = ram_bytes(profile)
+        boot = boot_times(profile, args.port) if args.port else {}
+        rows.append((profile, app_image_bytes(profile), dram, iram,
+                     boot.get("first_frame"), boot.get("first_control")))
+
+    print("| profile | flash (app image) | DRAM | IRAM | first frame ms | first control ms |")
+    print("|---|---:|---:|---:|---:|---:|")
+    for profile, flash, dram, iram, frame, control in rows:
+        print("| %s | %d | %d | %d | %s | %s |" % (profile, flash, dram, iram, ms(frame), ms(control)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,145 @@
+/**************************************
+ * Rules console test
+ * Runs the "rule" console command of components/rules on a host and checks what it
+ * compiles, rejects and deletes. The host's stack frames are far smaller than Xtensa's, so
+ * a condition nested too deeply would not overflow anything here. What is checked is that
+ * the compiler turns it away, which keeps its recursion within the Serial Cmd task's stack.
+ *
+ *   rules_test
+ *
+ * Prints each command and what the console answered, exits 1 if any check fails.
+ */
+#include "rules.h"
+#include "serial_cmd.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SAVED 1024
+
+uint32_t metric_counters[METRIC_NUM_COUNTERS];
+int32_t metric_gauges[METRIC_NUM_GAUGES];
+MetricHistogramData metric_histograms[METRIC_NUM_HISTOGRAMS];
+
+void metric_observe(MetricHistogram id, uint32_t duration_us){}
+
+static SerialCmdHandler rule_handler = NULL;
+static char saved[MAX_SAVED]; // what the rules wrote to nvs, one rule per line
+static int failures = 0;
+
+void serial_cmd_register(const char *name, const char *help, SerialCmdHandler handler){
+  if(strcmp(name, "rule") == 0){
+    rule_handler = handler;
+  }
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle){
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value){
+  snprintf(saved, sizeof(saved), "%s", value);
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out, size_t *len){
+  return ESP_FAIL; // nothing saved at boot
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle){
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle){}
+
+static void console(const char *args){
+  printf("rule %s\n", args);
+  rule_handler(args);
+}
+
+static void expect_saved(const char *what, const char *rules){
+  if(strcmp(saved, rules) != 0){
+    printf("FAIL %s: saved \"%s\", expected \"%s\"\n", what, saved, rules);
+    failures++;
+  }
+}
+
+static void expect_fires(const char *what, int inside, int fired){
+  RuleSnapshot snapshot = {0};
+  rule_snapshot_set(&snapshot, RULE_IN_INSIDE, inside);
+  RuleAction actions[CONFIG_RULES_MAX];
+  rules_evaluate(&snapshot, actions, CONFIG_RULES_MAX); // the rule fires on the edge, so start false
+  rule_snapshot_set(&snapshot, RULE_IN_INSIDE, -100);
+  rules_evaluate(&snapshot, actions, CONFIG_RULES_MAX);
+  rule_snapshot_set(&snapshot, RULE_IN_INSIDE, inside);
+  int n = rules_evaluate(&snapshot, actions, CONFIG_RULES_MAX);
+  if(n != fired){
+    printf("FAIL %s: %d rules fired, expected %d\n", what, n, fired);
+    failures++;
+  }
+}
+
+//"if " then depth brackets around 1, then the action
+static void nested(char *out, size_t len, int depth, bool closed){
+  int at = snprintf(out, len, "add if ");
+  for(int i = 0; i < depth; i++){
+    out[at++] = '(';
+  }
+  out[at++] = '1';
+  for(int i = 0; closed && i < depth; i++){
+    out[at++] = ')';
+  }
+  snprintf(out + at, len - at, " then fan 1");
+}
+
+int main(){
+  rules_init();
+  if(rule_handler == NULL){
+    printf("FAIL the rule command was not registered\n");
+    return 1;
+  }
+
+  console("add if inside > 27 then fan 60");
+  expect_saved("a plain rule", "if inside > 27 then fan 60\n");
+  expect_fires("a plain rule", 28, 1);
+
+  //the limit and one past it, with brackets, nots and a run that is never closed
+  char text[128];
+  nested(text, sizeof(text), 8, true);
+  console(text);
+  expect_saved("8 brackets", "if inside > 27 then fan 60\nif ((((((((1)))))))) then fan 1\n");
+  console("del 1");
+  nested(text, sizeof(text), 9, true);
+  console(text);
+  nested(text, sizeof(text), 32, true);
+  console(text);
+  nested(text, sizeof(text), 60, false); // still inside MAX_TEXT
+  console(text);
+  console("add if not not not not not not not not not inside > 1 then fan 1");
+  expect_saved("deep nesting", "if inside > 27 then fan 60\n");
+
+  //a delete only takes a whole index, anything else must leave rule 0 alone
+  console("del abc");
+  console("del 0x");
+  console("del ");
+  console("del 5");
+  expect_saved("bad deletes", "if inside > 27 then fan 60\n");
+
+  console("add if inside > 1 then lamp 99999999999");
+  console("add if inside > 1 then lamp 101");
+  expect_saved("bad percentages", "if inside > 27 then fan 60\n");
+  console("add if inside > 1 then lamp 100");
+  expect_saved("a full percentage", "if inside > 27 then fan 60\nif inside > 1 then lamp 100\n");
+  expect_fires("both rules", 28, 2);
+
+  console("del 0");
+  expect_saved("a good delete", "if inside > 1 then lamp 100\n");
+  console("clear");
+  expect_saved("clear", "");
+
+  printf("%s\n", failures == 0 ? "ok" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+#include <stdint.h>
+
+static inline int64_t esp_timer_get_time(void){
+  return 0; // rule timing is not what the test checks
+}
+
+#endif
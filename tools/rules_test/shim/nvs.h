@@ -0,0 +1,19 @@
+#ifndef NVS_H
+#define NVS_H
+#include <stddef.h>
+#include <stdint.h>
+
+//one string key in memory, rules_test.c keeps it
+typedef int esp_err_t;
+typedef int nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle);
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value);
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out, size_t *len);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+#endif
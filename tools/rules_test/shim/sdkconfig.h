@@ -0,0 +1,3 @@
+//the Kconfig defaults of the rules component
+#define CONFIG_RULES_MAX 8
+#define CONFIG_RULES_MAX_CODE_BYTES 48
@@ -0,0 +1,221 @@
+/**************************************
+ * SPSC ring stress test
+ * Runs spsc_ring with a producer and a consumer thread, standing in for the ISR and the
+ * task that drains it, and checks what came out against what went in.
+ *
+ *   spsc_stress [-n EVENTS]
+ *
+ *   retry  the producer pushes again until a full ring has room, every event must arrive
+ *          once and in order, and overflow must count each push that found the ring full
+ *   drop   the producer moves on when the ring is full, like the button and pot ISRs. It
+ *          pushes in bursts of 1 to 16 with a yield between them, so the consumer gets to
+ *          run even on one core and the ring both drains and overflows. What arrives must
+ *          be in order and, with overflow, account for every push
+ *   queue  the retry run through a mutex guarded ring of the same size, a stand in for
+ *          the FreeRTOS queue the ISRs used before, to compare the cost per event
+ *
+ * Both ring runs start the indices just short of 2^32 so they wrap during the run. Each
+ * entry carries its sequence number in the value and a function of it in the time, so an
+ * entry read before the producer finished writing it shows up as a mismatch. Exits 1 if
+ * any check fails. Built with -fsanitize=thread, the sanitizer also checks that the ring's
+ * acquire and release pairs order the slot writes against the reads.
+ */
+#include "spsc_ring.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_EVENTS 2000000
+#define CAPACITY 8 // same as the button ring
+#define WRAP_START (UINT32_MAX - 1000) // indices cross 2^32 a thousand pushes in
+#define MAX_BURST (CAPACITY * 2) // longest run of pushes the drop producer makes without yielding
+
+SPSC_RING_DECLARE(StressRing, stress_ring, uint32_t, CAPACITY)
+
+typedef enum {
+  MODE_RETRY = 0,
+  MODE_DROP = 1,
+  MODE_QUEUE = 2,
+} Mode;
+
+static const char *mode_names[] = {"retry", "drop", "queue"};
+
+//a mutex around a plain ring, what a locked queue costs per event
+typedef struct {
+  pthread_mutex_t lock;
+  uint32_t head;
+  uint32_t tail;
+  StressRingEntry slots[CAPACITY];
+} LockedQueue;
+
+typedef struct {
+  Mode mode;
+  uint32_t events;
+  StressRing ring;
+  LockedQueue queue;
+  pthread_barrier_t start; // neither thread starts before the other is running
+  int producer_done; // set once the producer has made its last push
+  uint32_t full; // pushes that found the ring full, counted by the producer
+  uint32_t received;
+  uint32_t errors;
+} Run;
+
+static int64_t stamp(uint32_t seq){
+  return (int64_t)seq * 7 + 3;
+}
+
+static bool queue_push(LockedQueue *queue, uint32_t value, int64_t time_us){
+  pthread_mutex_lock(&queue->lock);
+  bool pushed = queue->head - queue->tail < CAPACITY;
+  if(pushed){
+    queue->slots[queue->head % CAPACITY] = (StressRingEntry){ .time_us = time_us, .value = value };
+    queue->head++;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return pushed;
+}
+
+static bool queue_pop(LockedQueue *queue, StressRingEntry *entry){
+  pthread_mutex_lock(&queue->lock);
+  bool popped = queue->head != queue->tail;
+  if(popped){
+    *entry = queue->slots[queue->tail % CAPACITY];
+    queue->tail++;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return popped;
+}
+
+//xorshift, a fixed seed so a failing run can be repeated
+static uint32_t next_random(uint32_t *state){
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static void *producer(void *arg){
+  Run *run = arg;
+  uint32_t random = 1;
+  uint32_t burst = 0;
+  pthread_barrier_wait(&run->start);
+  for(uint32_t seq = 0; seq < run->events; seq++){
+    if(run->mode == MODE_DROP && burst-- == 0){
+      sched_yield();
+      burst = next_random(&random) % MAX_BURST;
+    }
+    while(true){
+      bool pushed = run->mode == MODE_QUEUE ? queue_push(&run->queue, seq, stamp(seq))
+                                            : stress_ring_push(&run->ring, seq, stamp(seq));
+      if(pushed){
+        break;
+      }
+      run->full++;
+      if(run->mode == MODE_DROP){
+        break;
+      }
+      sched_yield();
+    }
+  }
+  __atomic_store_n(&run->producer_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void *consumer(void *arg){
+  Run *run = arg;
+  uint32_t expect = 0; // lowest sequence number that may come next
+  pthread_barrier_wait(&run->start);
+  while(true){
+    StressRingEntry entry;
+    //read before popping, so an empty ring after the producer is done really is the end
+    int done = __atomic_load_n(&run->producer_done, __ATOMIC_ACQUIRE);
+    bool popped = run->mode == MODE_QUEUE ? queue_pop(&run->queue, &entry)
+                                          : stress_ring_pop(&run->ring, &entry);
+    if(!popped){
+      if(done){
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+    //dropped events leave gaps, the others must arrive exactly in order
+    bool in_order = run->mode == MODE_DROP ? entry.value >= expect : entry.value == expect;
+    if(!in_order || entry.time_us != stamp(entry.value)){
+      if(run->errors++ < 5){
+        fprintf(stderr, "%s: got %u time %lld, expected %s%u\n", mode_names[run->mode], entry.value,
+                (long long)entry.time_us, run->mode == MODE_DROP ? "at least " : "", expect);
+      }
+    }
+    expect = entry.value + 1;
+    run->received++;
+  }
+  return NULL;
+}
+
+static double now_ms(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+//runs one mode, prints its row and returns whether every check passed
+static bool run_mode(Mode mode, uint32_t events){
+  Run *run = calloc(1, sizeof(Run));
+  run->mode = mode;
+  run->events = events;
+  run->ring.head = WRAP_START;
+  run->ring.tail = WRAP_START;
+  pthread_mutex_init(&run->queue.lock, NULL);
+  pthread_barrier_init(&run->start, NULL, 2);
+
+  double start = now_ms();
+  pthread_t threads[2];
+  pthread_create(&threads[0], NULL, consumer, run);
+  pthread_create(&threads[1], NULL, producer, run);
+  pthread_join(threads[1], NULL);
+  pthread_join(threads[0], NULL);
+  double elapsed = now_ms() - start;
+
+  uint32_t overflow = mode == MODE_QUEUE ? run->full : stress_ring_overflow(&run->ring);
+  bool accounted = mode == MODE_DROP ? run->received + overflow == events : run->received == events;
+  bool ok = run->errors == 0 && accounted && overflow == run->full;
+  printf("| %s | %u | %u | %u | %.1f | %.1f | %s |\n", mode_names[mode], events, run->received,
+         overflow, elapsed, elapsed * 1e6 / events, ok ? "ok" : "FAIL");
+  if(!accounted){
+    fprintf(stderr, "%s: %u received and %u overflowed of %u pushed\n", mode_names[mode], run->received, overflow, events);
+  }
+  if(overflow != run->full){
+    fprintf(stderr, "%s: overflow says %u, the producer found the ring full %u times\n", mode_names[mode], overflow, run->full);
+  }
+  pthread_mutex_destroy(&run->queue.lock);
+  pthread_barrier_destroy(&run->start);
+  free(run);
+  return ok;
+}
+
+int main(int argc, char **argv){
+  uint32_t events = DEFAULT_EVENTS;
+  int opt;
+  while((opt = getopt(argc, argv, "n:")) != -1){
+    switch(opt){
+      case('n'):
+        events = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n EVENTS]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  printf("| run | pushed | received | overflow | ms | ns per event | result |\n");
+  printf("|---|---:|---:|---:|---:|---:|---|\n");
+  bool ok = true;
+  ok &= run_mode(MODE_RETRY, events);
+  ok &= run_mode(MODE_DROP, events);
+  ok &= run_mode(MODE_QUEUE, events);
+  return ok ? 0 : 1;
+}
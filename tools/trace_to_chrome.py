@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Convert a DeskAssist trace dump into Chrome/Perfetto trace JSON.
+
+Capture the console output of the "trace" command (other log lines may be mixed in)
+and run:
+
+    tools/trace_to_chrome.py monitor.log -o trace.json
+
+then open trace.json in chrome://tracing or https://ui.perfetto.dev. Each core gets
+its own track.
+"""
+import argparse
+import json
+import sys
+
+TIME_WRAP = 1 << 32
+
+
+def parse(lines):
+    unit = None
+    events = {}
+    records = {}
+    lost = {}
+    for line in lines:
+        idx = line.find("TRACE ")
+        if idx < 0:
+            continue
+        fields = line[idx:].split()
+        kind = fields[1]
+        if kind == "BEGIN":
+            opts = dict(f.split("=", 1) for f in fields[2:])
+            unit = opts.get("unit")
+            if unit != "us":
+                sys.exit("trace dump is in %s, this converter reads microsecond dumps" % unit)
+            events.clear()
+            records.clear()
+            lost.clear()
+        elif kind == "EVENT":
+            events[int(fields[2])] = (fields[3], fields[4])
+        elif kind == "REC":
+            core, time_us, event, arg = (int(f) for f in fields[2:6])
+            records.setdefault(core, []).append((time_us, event, arg))
+        elif kind == "LOST":
+            lost[int(fields[2])] = int(fields[3])
+    if unit is None:
+        sys.exit("no TRACE BEGIN line found in input")
+    return events, records, lost
+
+
+def to_chrome(events, records):
+    out = []
+    for core, recs in sorted(records.items()):
+        out.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": core,
+                    "args": {"name": "core %d" % core}})
+        # the timestamp is 32 bits of microseconds and wraps every 71 minutes, unwrap it per
+        # core. An ISR can leave its record slightly out of order, so only a drop of more than
+        # half the range is a wrap
+        base = 0
+        prev = None
+        for time_us, event, arg in recs:
+            if prev is not None and prev - time_us > TIME_WRAP // 2:
+                base += TIME_WRAP
+            prev = time_us
+            phase, name = events.get(event, ("i", "event%d" % event))
+            entry = {
+                "name": name,
+                "ph": phase,
+                "pid": 0,
+                "tid": core,
+                "ts": base + time_us,
+                "args": {"arg": arg},
+            }
+            if phase == "i":
+                entry["s"] = "t"
+            out.append(entry)
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", help="console log containing a trace dump, - for stdin")
+    parser.add_argument("-o", "--output", default="-", help="output json file")
+    args = parser.parse_args()
+
+    src = sys.stdin if args.dump == "-" else open(args.dump, errors="replace")
+    events, records, lost = parse(src)
+    for core, count in sorted(lost.items()):
+        print("core %d: %d older events were overwritten" % (core, count), file=sys.stderr)
+
+    trace = {"traceEvents": to_chrome(events, records), "displayTimeUnit": "ns"}
+    dst = sys.stdout if args.output == "-" else open(args.output, "w")
+    json.dump(trace, dst)
+
+
+if __name__ == "__main__":
+    main()